@@ -3,411 +3,2039 @@
 
 #include "AIDirector.h"
 #include "Kismet/GameplayStatics.h"
+#include "GunslingersGameMode.h"
+#include "GunslingersCharacter.h"
+#include "CoverLevelData.h"
 #include "CoverObject.h"
 #include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/IConsoleManager.h"
+#include "NavigationSystem.h"
+#include "NavigationData.h"
+#include "Engine/Engine.h"
+#include "GameFramework/Character.h"
+#include "Misc/AutomationTest.h"
+#include "Math/RandomStream.h"
+
+DECLARE_STATS_GROUP(TEXT("Cover"), STATGROUP_Cover, STATCAT_Advanced);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Candidate Cache Hits"), STAT_CoverCandidateCacheHits, STATGROUP_Cover);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Candidate Cache Misses"), STAT_CoverCandidateCacheMisses, STATGROUP_Cover);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Candidate Cache Rebuilds"), STAT_CoverCandidateCacheRebuilds, STATGROUP_Cover);
+DECLARE_CYCLE_STAT(TEXT("Squad Assignment"), STAT_CoverSquadAssignment, STATGROUP_Cover);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Squad Assignment Timeouts"), STAT_CoverSquadAssignmentTimeouts, STATGROUP_Cover);
+DECLARE_CYCLE_STAT(TEXT("Scheduled Work"), STAT_AIDirectorScheduledWork, STATGROUP_Cover);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Scheduled Items Run"), STAT_AIDirectorItemsRun, STATGROUP_Cover);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Scheduled Items Rolled Over"), STAT_AIDirectorItemsRolledOver, STATGROUP_Cover);
+
+static TAutoConsoleVariable<int32> CVarCoverCandidateCache(
+	TEXT("ai.Cover.CandidateCache"),
+	1,
+	TEXT("If zero the AI director walks the cover grid on every query instead of reusing the covers found for the player's cell."));
+
+static TAutoConsoleVariable<int32> CVarCoverDrawInfluence(
+	TEXT("ai.Cover.DrawInfluenceMap"),
+	0,
+	TEXT("If non-zero the AI director draws its danger map every frame."));
+
+static TAutoConsoleVariable<int32> CVarCoverSquadAssignment(
+	TEXT("ai.Cover.SquadAssignment"),
+	1,
+	TEXT("If zero batched cover requests are handed out greedily in request order instead of being assigned to the whole squad together."));
+
+namespace
+{
+	//Kinds of scheduled work, combined with the agent's unique id so each agent has at most one of each queued
+	enum class EDirectorWork : uint64
+	{
+		SquadAssignment = 1,
+		NavCosts = 2,
+		LineOfSight = 3,
+		CoverCheck = 4
+	};
+
+	uint64 MakeWorkKey(EDirectorWork work, const UObject* object = nullptr)
+	{
+		return ((uint64)work << 32) | (object ? object->GetUniqueID() : 0);
+	}
+
+	//Squad assignment answers requests that are already waiting, so it goes before everything else
+	const float SquadAssignmentPriority = 100.f;
+
+	//The async grid snapshot is copied again once more than one in this many covers have moved since it was last copied, so the copy costs a fixed amount per move
+	const int32 SnapshotCopyMoveFraction = 8;
+
+	//Path cost to the cover if it is known, otherwise straight line distance. FCoverNavCostRow::Unreachable if there is no path to it
+	float GetRankingDistance(const FCoverNavCostRow* travelCosts, int32 id, float distanceToAI)
+	{
+		if (travelCosts)
+		{
+			const float cost = travelCosts->GetCost(id);
+			if (cost >= 0.f)
+			{
+				return cost;
+			}
+		}
+		return distanceToAI;
+	}
+}
+
+//Everything an async cover query reads and writes. The worker only touches this, never the director, so the director can keep changing covers while it runs
+struct FCoverAsyncBatch
+{
+	TSharedPtr<const FCoverSpatialGrid, ESPMode::ThreadSafe> Grid;
+	//Covers that were reserved, disabled, exposed to the player or moved since the grid snapshot when the batch was dispatched
+	TBitArray<> UnavailableCovers;
+	//The cover in each id when the batch was dispatched, only compared against on the game thread to catch ids that were reused
+	TArray<AActor*> Covers;
+	int32 MaxCandidates = 1;
+
+	//Scoring input for each request with its threats already picked, and the cached covers around that threat if there are any
+	TArray<FCoverScoringInput> Inputs;
+	TArray<TSharedPtr<const FCoverGridCell, ESPMode::ThreadSafe>> BandCandidates;
+	//Path costs from the cover each requester is in
+	TArray<TSharedPtr<const FCoverNavCostRow, ESPMode::ThreadSafe>> TravelCosts;
+	TArray<TEnumAsByte<MovementTypes>> Types;
+	//Copy of the danger map, the inputs point at it
+	TSharedPtr<const FCoverInfluenceMap, ESPMode::ThreadSafe> Influence;
+	//Copy of the exposure table, the inputs point at it
+	TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> Exposure;
+
+	//Written by the worker, best first for each request
+	TArray<TArray<int32>> Candidates;
+	TArray<TArray<float>> Scores;
+};
 
 // Sets default values
 AAIDirector::AAIDirector()
 {
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
-
-	FindAllCovers();
 }
 
 float AAIDirector::GetDistanceFromAIToPlayer(FVector pos)
 {
-	FVector playerLoc = GetWorld()->GetFirstPlayerController()->GetPawn()->GetActorLocation();
+	APawn* player = GetNearestThreat(pos);
+	if (player == nullptr)
+	{
+		return MAX_flt;
+	}
+	FVector playerLoc = player->GetActorLocation();
 	float dist = (playerLoc - pos).Size();
 	return dist;
 }
 
-void AAIDirector::FindAllCovers()
+AAIDirector* AAIDirector::Get(const UObject* worldContextObject)
 {
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), ACoverObject::StaticClass(), AllCovers);
+	AGunslingersGameMode* gameMode = Cast<AGunslingersGameMode>(UGameplayStatics::GetGameMode(worldContextObject));
+	return gameMode ? gameMode->AIDirector : nullptr;
 }
 
-AActor * AAIDirector::GetClosestCover(FVector pos)
+//REGISTRATION
+int32 AAIDirector::RegisterCover(AActor * cover)
 {
-	FVector coverLoc = AllCovers[0]->GetActorLocation();
-
-	int currentWinner = 0;
-	float currentClosestDistance = (coverLoc - pos).Size();
-	float tmpDistance;
+	if (cover == nullptr)
+	{
+		return INDEX_NONE;
+	}
+	int32 id = GetCoverId(cover);
+	if (id != INDEX_NONE)
+	{
+		return id;
+	}
 
-	for (int i = 1; i < AllCovers.Num(); i++)
+	//Reuse the slot of a cover that has been unregistered if there is one, otherwise grow every per cover array
+	if (FreeCoverIds.Num() > 0)
 	{
-		coverLoc = AllCovers[i]->GetActorLocation();
-		tmpDistance = (coverLoc - pos).Size();
-		if (tmpDistance < currentClosestDistance)
-		{
-			currentClosestDistance = tmpDistance;
-			currentWinner = i;
-		}
+		id = FreeCoverIds.Pop(false);
+		CoverTable[id] = cover;
+	}
+	else
+	{
+		id = CoverTable.Add(cover);
+		ReservedCovers.Add(false);
+		CoverOwners.AddDefaulted();
+		CoverLeaseExpiryTimes.Add(0.f);
+		CoverBakedIndices.Add(INDEX_NONE);
+		DisabledCovers.Add(false);
+		HighCovers.Add(false);
+		CoverMovedSinceSnapshot.Add(false);
+		CoverExposure.AddZeroed(FCoverPoint::NumExposureSectors);
 	}
-	return AllCovers[currentWinner];
+	CoverBakedIndices[id] = CoverLevelData ? CoverLevelData->GetBakedIndex(cover) : INDEX_NONE;
+	const ACoverObject* coverObject = Cast<ACoverObject>(cover);
+	DisabledCovers[id] = coverObject && coverObject->IsCoverDisabled();
+	UpdateCoverExposure(id);
 
+	CoverIds.Add(cover, id);
+	CoverGrid.Add(id, cover->GetActorLocation(), cover->GetActorForwardVector());
+	CoverGridSnapshot.Reset();
+	for (FCoverCandidateCache& cache : CandidateCaches)
+	{
+		cache.Candidates.Reset();
+	}
+	CoverPointBVHDirty = true;
+	//The new cover needs a row of its own and a place in its neighbours' rows
+	NavCosts.MarkDirty(id);
+	MarkNavCostRowsNear(FBox(cover->GetActorLocation(), cover->GetActorLocation()));
+	return id;
 }
 
-//FIND ALL
-TArray<AActor*> AAIDirector::FindAllFlankingCovers()
-{
-	TArray<AActor*> flankingCovers;
-	FVector playerLoc = GetWorld()->GetFirstPlayerController()->GetPawn()->GetActorLocation();
-	FVector playerForward = GetWorld()->GetFirstPlayerController()->GetPawn()->GetActorForwardVector();
-	float distanceBetweenCoverAndPlayer = 0.f;
-	float dotProduct = 0.f;
-	FVector directionalVectorBetweenPlayerAndCover;
-	AActor* tmpCover;
+void AAIDirector::UnregisterCover(AActor * cover)
+{
+	int32 id = GetCoverId(cover);
+	if (id == INDEX_NONE)
+	{
+		return;
+	}
+
+	//The AI holding it has to find another
+	NotifyCoverHolder(id, true);
+	CoverGrid.Remove(id);
+	CoverGridSnapshot.Reset();
+	for (FCoverCandidateCache& cache : CandidateCaches)
+	{
+		cache.Candidates.Reset();
+	}
 
-	for (int i = 0; i < AllCovers.Num(); i++)
+	//Its boxes are switched off rather than the tree rebuilt, they are dropped the next time a cover registers
+	const int32 firstBox = GetCoverPointFirstBox(id, Cast<ACoverObject>(cover));
+	for (int32 box = firstBox; box != INDEX_NONE && CoverPointRefs.IsValidIndex(box) && CoverPointRefs[box].CoverObject == cover; box++)
 	{
-		tmpCover = AllCovers[i];
-		distanceBetweenCoverAndPlayer = (playerLoc - tmpCover->GetActorLocation()).Size();
+		CoverPointBVH.SetEnabled(box, false);
+	}
+	if (CoverBVHFirstBoxes.IsValidIndex(id))
+	{
+		CoverBVHFirstBoxes[id] = INDEX_NONE;
+	}
+
+	CoverIds.Remove(cover);
+	CoverTable[id] = nullptr;
+	DisabledCovers[id] = false;
+	HighCovers[id] = false;
+	FreeCoverIds.Add(id);
+	NavCosts.RemoveRow(id);
+	MarkNavCostRowsNear(FBox(cover->GetActorLocation(), cover->GetActorLocation()));
+}
+
+//NAVIGATION COSTS
+float AAIDirector::GetTravelCost(AActor * fromCover, AActor * toCover, FVector pos)
+{
+	if (toCover == nullptr)
+	{
+		return MAX_flt;
+	}
+	const float cost = NavCosts.GetCost(GetCoverId(fromCover), GetCoverId(toCover));
+	return cost >= 0.f ? cost : (toCover->GetActorLocation() - pos).Size();
+}
+
+void AAIDirector::MarkNavCostsDirty(FBox bounds)
+{
+	PendingNavDirtyBounds.Add(bounds);
+}
 
-		//If the distance of the cover to the player is either too far that it would cause the AI to have to advance, or too close that they would have to retreat then it is not valid cover
-		if (distanceBetweenCoverAndPlayer < MaxDistanceAwayFromPlayer && distanceBetweenCoverAndPlayer > MinDistanceAwayFromPlayer)
+void AAIDirector::MarkNavCostRowsNear(const FBox& bounds)
+{
+	const float radiusSquared = NavCostRadius * NavCostRadius;
+	CoverGrid.ForEachCellInAnnulus(bounds.GetCenter(), 0.f, bounds.GetExtent().Size() + NavCostRadius, [&](const FCoverGridCell& cell)
+	{
+		for (int i = 0; i < cell.Num(); i++)
 		{
-			//Otherwise it is in range and the directional vector needs to be calculated
-			directionalVectorBetweenPlayerAndCover = tmpCover->GetActorLocation() - playerLoc;
-			directionalVectorBetweenPlayerAndCover.Normalize();
-			//Calculate dot product between directional vector and player forward. essentially we are looking for cover objects that are behind the player
-			dotProduct = FVector::DotProduct(playerForward, directionalVectorBetweenPlayerAndCover);
-			//If dot product is less than zero it means the cover is behind the player
-			if (dotProduct < 0)
+			if (bounds.ComputeSquaredDistanceToPoint(cell.GetLocation(i)) <= radiusSquared)
 			{
-				flankingCovers.Add(tmpCover);
+				NavCosts.MarkDirty(cell.Ids[i]);
 			}
 		}
+	});
+}
+
+FVector AAIDirector::GetNavLocation(int32 id, const FVector& towards) const
+{
+	//The cover object itself is inside its mesh and off the navmesh, the cover points around it are where the AI actually stand
+	const ACoverObject* coverObject = Cast<ACoverObject>(CoverTable[id]);
+	if (coverObject == nullptr || coverObject->CoverPoints.Num() == 0)
+	{
+		return CoverTable[id]->GetActorLocation();
 	}
 
-	return flankingCovers;
+	//Disabled sides are not somewhere to go
+	FVector closest = CoverTable[id]->GetActorLocation();
+	float closestDistance = MAX_flt;
+	for (const FCoverPoint& point : coverObject->CoverPoints)
+	{
+		const float distance = (point.Location - towards).SizeSquared();
+		if (point.Enabled && distance < closestDistance)
+		{
+			closest = point.Location;
+			closestDistance = distance;
+		}
+	}
+	return closest;
 }
 
-TArray<AActor*> AAIDirector::FindAllNormalCovers(FVector pos)
+void AAIDirector::UpdateNavCosts()
 {
-	TArray<AActor*> normalCovers;
-	FVector playerLoc = GetWorld()->GetFirstPlayerController()->GetPawn()->GetActorLocation();
-	float distanceBetweenCoverAndPlayer = 0.f;
-	float distanceBetweenCoverAndAI = 0.f;
-	AActor* tmpCover;
+	UNavigationSystemV1* navSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	//Paths found while tiles are being rebuilt would be out of date as soon as they finish, also counts dirty areas that haven't started building yet
+	if (navSys == nullptr || navSys->IsNavigationBuildInProgress())
+	{
+		return;
+	}
+	ANavigationData* navData = navSys->GetDefaultNavDataInstance(FNavigationSystem::DontCreate);
+	if (navData == nullptr)
+	{
+		return;
+	}
 
-	for (int i = 0; i < AllCovers.Num(); i++)
+	//Only the rows around what changed are rebuilt
+	for (const FBox& bounds : PendingNavDirtyBounds)
 	{
-		tmpCover = AllCovers[i];
-		distanceBetweenCoverAndPlayer = (playerLoc - tmpCover->GetActorLocation()).Size();
-		distanceBetweenCoverAndAI = (pos - tmpCover->GetActorLocation()).Size();
+		MarkNavCostRowsNear(bounds);
+	}
+	PendingNavDirtyBounds.Reset();
 
-		//If the distance of the cover to the player is either too far that it would cause the AI to have to advance, or too close that they would have to retreat then it is not valid cover
-		if (distanceBetweenCoverAndPlayer < MaxDistanceAwayFromPlayer && distanceBetweenCoverAndPlayer > MinDistanceAwayFromPlayer)
+	while (NavCostQueries.Num() < MaxNavCostQueriesInFlight && NavCosts.HasDirty())
+	{
+		int32 id = NavCosts.PopDirty();
+		if (id != INDEX_NONE && CoverTable.IsValidIndex(id) && CoverTable[id])
 		{
-			if (distanceBetweenCoverAndAI <= 800)
-			{
-				normalCovers.Add(tmpCover);
-			}
+			StartNavCostRow(id, *navSys, *navData);
 		}
 	}
-
-	return normalCovers;
 }
 
-TArray<AActor*> AAIDirector::FindAllRetreatingCovers(FVector pos, FVector forward)
+void AAIDirector::StartNavCostRow(int32 id, UNavigationSystemV1& navSys, ANavigationData& navData)
 {
-	TArray<AActor*> retreatingCovers;
-	FVector playerLoc = GetWorld()->GetFirstPlayerController()->GetPawn()->GetActorLocation();
-	float distanceBetweenCoverAndPlayer = 0.f;
-	float dotProduct = 0.f;
-	FVector directionalVectorBetweenCoverAndAI;
-	AActor* tmpCover;
+	const FVector location = CoverTable[id]->GetActorLocation();
+	const float radiusSquared = NavCostRadius * NavCostRadius;
 
-	for (int i = 0; i < AllCovers.Num(); i++)
+	//Replaces any build of this row already running, its results are ignored because the generation has moved on
+	FNavCostRowBuild& build = NavCostRowBuilds.Add(id);
+	build.Generation = NavCosts.GetGeneration(id);
+	CoverGrid.ForEachCellInAnnulus(location, 0.f, NavCostRadius, [&](const FCoverGridCell& cell)
 	{
-		tmpCover = AllCovers[i];
-		distanceBetweenCoverAndPlayer = (playerLoc - tmpCover->GetActorLocation()).Size();
-
-		//If the distance of the cover to the player is either too far that it would cause the AI to have to advance, or too close that they would have to retreat then it is not valid cover
-		if (distanceBetweenCoverAndPlayer < MaxDistanceAwayFromPlayer && distanceBetweenCoverAndPlayer > MinDistanceAwayFromPlayer)
+		for (int i = 0; i < cell.Num(); i++)
 		{
-			//Otherwise it is in range and the directional vector needs to be calculated
-			directionalVectorBetweenCoverAndAI = tmpCover->GetActorLocation() - pos;
-			directionalVectorBetweenCoverAndAI.Normalize();
-			//Calculate dot product between directional vector and AI forward. essentially we are looking for cover objects that are behind the enemy, thus retreating covers
-			dotProduct = FVector::DotProduct(forward, directionalVectorBetweenCoverAndAI);
-			//If dot product is less than zero it means the cover is behind the AI
-			if (dotProduct < 0)
+			if (cell.Ids[i] != id && (cell.GetLocation(i) - location).SizeSquared() <= radiusSquared)
 			{
-				retreatingCovers.Add(tmpCover);
+				build.Ids.Add(cell.Ids[i]);
 			}
 		}
-	}
+	});
+	build.Costs.Init(FCoverNavCostRow::Unreachable, build.Ids.Num());
+	build.Remaining = build.Ids.Num();
 
-	return retreatingCovers;
+	if (build.Remaining == 0)
+	{
+		NavCosts.SetRow(id, build.Generation, MakeShared<FCoverNavCostRow, ESPMode::ThreadSafe>());
+		NavCostRowBuilds.Remove(id);
+		return;
+	}
 
+	//Paths are found on the navigation system's async worker and handed back on the game thread
+	const FNavPathQueryDelegate onPathFound = FNavPathQueryDelegate::CreateUObject(this, &AAIDirector::OnNavCostPathFound);
+	for (int slot = 0; slot < build.Ids.Num(); slot++)
+	{
+		const int32 otherId = build.Ids[slot];
+		const FVector otherLocation = CoverTable[otherId]->GetActorLocation();
+		FPathFindingQuery query(this, navData, GetNavLocation(id, otherLocation), GetNavLocation(otherId, location));
+		const uint32 queryId = navSys.FindPathAsync(navData.GetConfig(), query, onPathFound, EPathFindingMode::Regular);
 
+		FNavCostQuery& navCostQuery = NavCostQueries.Add(queryId);
+		navCostQuery.RowId = id;
+		navCostQuery.Generation = build.Generation;
+		navCostQuery.Slot = slot;
+	}
 }
 
-TArray<AActor*> AAIDirector::FindAllAdvancingCovers(FVector pos, FVector forward)
+void AAIDirector::OnNavCostPathFound(uint32 queryId, ENavigationQueryResult::Type result, FNavPathSharedPtr path)
 {
-	TArray<AActor*> advancingCovers;
-	FVector playerLoc = GetWorld()->GetFirstPlayerController()->GetPawn()->GetActorLocation();
-	float distanceBetweenCoverAndPlayer = 0.f;
-	float dotProduct = 0.f;
-	FVector directionalVectorBetweenAIAndPlayer;
-	FVector directionalVectorBetweenCoverAndPlayer;
-	FVector directionalVectorBetweenCoverAndAI;
-	AActor* tmpCover;
-
-	for (int i = 0; i < AllCovers.Num(); i++)
+	FNavCostQuery query;
+	if (!NavCostQueries.RemoveAndCopyValue(queryId, query))
 	{
-		tmpCover = AllCovers[i];
-		distanceBetweenCoverAndPlayer = (playerLoc - tmpCover->GetActorLocation()).Size();
-
-		//If the distance of the cover to the player is either too far that it would cause the AI to have to advance, or too close that they would have to retreat then it is not valid cover
-		if (distanceBetweenCoverAndPlayer < MaxDistanceAwayFromPlayer && distanceBetweenCoverAndPlayer > MinDistanceAwayFromPlayer)
-		{
-			//Otherwise it is in range and the directional vector needs to be calculated
-			directionalVectorBetweenCoverAndAI = tmpCover->GetActorLocation() - pos;
-			directionalVectorBetweenCoverAndAI.Normalize();
-			//Calculate dot product between directional vector and AI forward. to start advancing covers have to not be behind enemy, opposite logic of flanking
-			dotProduct = FVector::DotProduct(forward, directionalVectorBetweenCoverAndAI);
-			//If dot product is greater than it means the cover is not behind the AI
-			if (dotProduct > 0)
-			{
-				//If the cover is not behind enemy than the next check is if it is inbetween player and AI (Advancing is cover not behind the AI, and cover that is looking at the player in the same direction of the AI thus on the same side of the player)
-				
-				//Direction enemy is looking to see player
-				directionalVectorBetweenAIAndPlayer = playerLoc - pos;
-				directionalVectorBetweenAIAndPlayer.Normalize();
+		return;
+	}
+	FNavCostRowBuild* build = NavCostRowBuilds.Find(query.RowId);
+	if (build == nullptr || build->Generation != query.Generation)
+	{
+		return;
+	}
 
-				//Direction cover object is looking to see player
-				directionalVectorBetweenCoverAndPlayer = playerLoc - tmpCover->GetActorLocation();
-				directionalVectorBetweenCoverAndPlayer.Normalize();
+	//Partial paths don't reach the cover so they count as unreachable
+	if (result == ENavigationQueryResult::Success && path.IsValid() && path->IsValid() && !path->IsPartial())
+	{
+		build->Costs[query.Slot] = path->GetCost();
+	}
 
-				//Calculate dot product between the way cover has to look to see player, and way the AI does, if they are the same it means the cover is not on the other side of the player
-				//to the AI (they player is not between them, that mixes with not behind player to ensure advancing cover)
-				dotProduct = FVector::DotProduct(directionalVectorBetweenCoverAndPlayer, directionalVectorBetweenAIAndPlayer);
+	build->Remaining--;
+	if (build->Remaining > 0)
+	{
+		return;
+	}
 
-				if (dotProduct > 0)
-				{
-					advancingCovers.Add(tmpCover);
-				}
-			}
-		}
+	//Every query is back, sort by id so lookups can binary search
+	TArray<int32> order;
+	for (int i = 0; i < build->Ids.Num(); i++)
+	{
+		order.Add(i);
 	}
+	order.Sort([build](int32 a, int32 b) { return build->Ids[a] < build->Ids[b]; });
 
-	return advancingCovers;
+	TSharedRef<FCoverNavCostRow, ESPMode::ThreadSafe> row = MakeShared<FCoverNavCostRow, ESPMode::ThreadSafe>();
+	for (int32 index : order)
+	{
+		row->Ids.Add(build->Ids[index]);
+		row->Costs.Add(build->Costs[index]);
+	}
+	NavCosts.SetRow(query.RowId, query.Generation, row);
+	NavCostRowBuilds.Remove(query.RowId);
 }
 
-
-//GET COVERS
-AActor * AAIDirector::GetFlankingCover(FVector pos, AActor * coverAIIsIn)
+void AAIDirector::SetCoverLevelData(ACoverLevelData * levelData)
 {
-	TArray<AActor*> allFlankingCovers = FindAllFlankingCovers();
-
-	//If there are no valid covers return cover AI is already in so they stay put
-	if (allFlankingCovers.Num() == 0)
+	CoverLevelData = levelData;
+	//Covers that registered before the level data began play still need their baked index
+	for (int32 id = 0; id < CoverTable.Num(); id++)
 	{
-		return coverAIIsIn;
+		CoverBakedIndices[id] = CoverLevelData && CoverTable[id] ? CoverLevelData->GetBakedIndex(CoverTable[id]) : INDEX_NONE;
 	}
-	else
+}
+
+AActor * AAIDirector::GetClosestCover(FVector pos)
+{
+	int32 id = CoverGrid.FindNearest(pos, [this](int32 candidate) { return !IsCoverIdReserved(candidate) && !DisabledCovers[candidate]; });
+	return id != INDEX_NONE ? CoverTable[id] : nullptr;
+}
+
+//COVER POINT PICKING
+void AAIDirector::BuildCoverPointBVH()
+{
+	CoverPointBVH.Reset();
+	CoverPointRefs.Reset();
+	CoverBVHFirstBoxes.Init(INDEX_NONE, CoverTable.Num());
+	for (int32 id = 0; id < CoverTable.Num(); id++)
 	{
-		//If there is only one cover return that = no distance competition
-		if (allFlankingCovers.Num() == 1)
+		ACoverObject* coverObject = Cast<ACoverObject>(CoverTable[id]);
+		if (coverObject == nullptr)
 		{
-			return allFlankingCovers[0];
+			continue;
 		}
-		//Calculate each covers distance to the AI and pick the furthest away (as that makes better flanking cover)
-		else
+		//Payloads are the index of the box, so the boxes of one cover are found from its first
+		CoverBVHFirstBoxes[id] = CoverPointRefs.Num();
+		for (int32 i = 0; i < coverObject->CoverPoints.Num(); i++)
 		{
-			FVector coverLoc = allFlankingCovers[0]->GetActorLocation();
-			int currentWinner = 0;
-			float currentFurthestDistance = (coverLoc- pos).Size();
-			float tmpDistance;
+			const FCoverPoint& point = coverObject->CoverPoints[i];
+			CoverPointBVH.Add(point.Location, point.Rotation.Quaternion(), point.Extent, CoverPointRefs.Num());
+			CoverPointBVH.SetEnabled(CoverPointRefs.Num(), point.Enabled);
+			CoverPointRefs.Add(FCoverPointRef(coverObject, i));
+		}
+	}
+	CoverPointBVH.Build();
+	CoverPointBVHDirty = false;
+}
 
-			//For all flanking covers, calculate distance, make it the winner if it is further
-			for (int i = 1; i < allFlankingCovers.Num(); i++)
-			{
-				coverLoc = allFlankingCovers[i]->GetActorLocation();
-				tmpDistance = (coverLoc - pos).Size();
-				if (tmpDistance > currentFurthestDistance)
-				{
-					currentFurthestDistance = tmpDistance;
-					currentWinner = i;
-				}
-			}
-			return allFlankingCovers[currentWinner];
+FCoverPointRef AAIDirector::RaycastCoverPoints(FVector origin, FVector direction, float length, TArray<FCoverPointRef>& outCovers)
+{
+	outCovers.Reset();
+	if (CoverPointBVHDirty)
+	{
+		BuildCoverPointBVH();
+	}
+
+	TArray<FCoverPointHit> hits;
+	CoverPointBVH.Raycast(origin, direction.GetSafeNormal(), length, hits);
+	for (const FCoverPointHit& hit : hits)
+	{
+		const FCoverPointRef& coverPoint = CoverPointRefs[hit.Payload];
+		if (coverPoint.IsValid())
+		{
+			outCovers.Add(coverPoint);
 		}
 	}
+	return outCovers.Num() > 0 ? outCovers[0] : FCoverPointRef();
 }
 
-AActor * AAIDirector::GetNormalCover(FVector pos, AActor * coverAIIsIn)
+int32 AAIDirector::GetCoverPointFirstBox(int32 id, const ACoverObject* coverObject) const
 {
-	TArray<AActor*> allNormalCovers = FindAllNormalCovers(pos);
+	//Nothing to update in place if the tree is going to be rebuilt anyway
+	if (CoverPointBVHDirty || coverObject == nullptr || coverObject->CoverPoints.Num() == 0 || !CoverBVHFirstBoxes.IsValidIndex(id) || CoverBVHFirstBoxes[id] == INDEX_NONE)
+	{
+		return INDEX_NONE;
+	}
+	//The tree has to have been built with the cover's points as they are now
+	const int32 last = CoverBVHFirstBoxes[id] + coverObject->CoverPoints.Num() - 1;
+	if (!CoverPointRefs.IsValidIndex(last) || CoverPointRefs[last].CoverObject != coverObject || CoverPointRefs[last].Index != coverObject->CoverPoints.Num() - 1)
+	{
+		return INDEX_NONE;
+	}
+	return CoverBVHFirstBoxes[id];
+}
 
-	//If there are no valid covers return cover AI is already in so they stay put
-	if (allNormalCovers.Num() == 0)
+//LIFECYCLE
+void AAIDirector::UpdateCoverLocation(AActor * cover, FVector previousLocation)
+{
+	int32 id = GetCoverId(cover);
+	if (id == INDEX_NONE)
 	{
-		return coverAIIsIn;
+		return;
 	}
-	else
+	const FVector location = cover->GetActorLocation();
+
+	//Only its own entry in the grid moves, and only the candidate caches it has left or entered are thrown away
+	CoverGrid.Remove(id);
+	CoverGrid.Add(id, location, cover->GetActorForwardVector());
+	InvalidateCandidateCachesNear(previousLocation);
+	InvalidateCandidateCachesNear(location);
+
+	//The async snapshot still has it where it was, so it is left out of async batches until the snapshot is next copied
+	if (!CoverMovedSinceSnapshot[id])
 	{
-		//If there is only one cover return that = no distance competition
-		if (allNormalCovers.Num() == 1)
+		CoverMovedSinceSnapshot[id] = true;
+		NumCoversMovedSinceSnapshot++;
+		if (NumCoversMovedSinceSnapshot * SnapshotCopyMoveFraction > CoverGrid.Num())
 		{
-			return allNormalCovers[0];
+			CoverGridSnapshot.Reset();
 		}
-		//Calculate each covers distance to the AI and pick the closest one
-		else
-		{
-			FVector coverLoc = allNormalCovers[0]->GetActorLocation();
-			int currentWinner = 0;
-			float currentClosestDistance = (coverLoc - pos).Size();
-			float tmpDistance;
+	}
 
-			//For all normal covers, calculate distance, make it the winner if it is further
-			for (int i = 1; i < allNormalCovers.Num(); i++)
-			{
-				coverLoc = allNormalCovers[i]->GetActorLocation();
-				tmpDistance = (coverLoc - pos).Size();
-				if (tmpDistance < currentClosestDistance)
-				{
-					currentClosestDistance = tmpDistance;
-					currentWinner = i;
-				}
-			}
-			return allNormalCovers[currentWinner];
+	//Its boxes are moved in place and the nodes above them refit
+	const ACoverObject* coverObject = Cast<ACoverObject>(cover);
+	const int32 firstBox = GetCoverPointFirstBox(id, coverObject);
+	if (firstBox != INDEX_NONE)
+	{
+		for (int32 i = 0; i < coverObject->CoverPoints.Num(); i++)
+		{
+			const FCoverPoint& point = coverObject->CoverPoints[i];
+			CoverPointBVH.Update(firstBox + i, point.Location, point.Rotation.Quaternion(), point.Extent);
 		}
 	}
+
+	//Its sides face a new way
+	UpdateCoverExposure(id);
+
+	//What it could see was baked where it used to be
+	if (CoverLevelData)
+	{
+		CoverLevelData->InvalidateBakedCoverObject(cover);
+	}
+	CoverBakedIndices[id] = INDEX_NONE;
+
+	//Paths to and from it are found again
+	NavCosts.MarkDirty(id);
+	MarkNavCostRowsNear(FBox(previousLocation, previousLocation));
+	MarkNavCostRowsNear(FBox(location, location));
+
+	NotifyCoverHolder(id, false);
 }
 
-AActor * AAIDirector::GetRetreatingCover(FVector pos, FVector forward, AActor * coverAIIsIn)
+void AAIDirector::UpdateCoverPoint(AActor * cover, int32 pointIndex)
 {
-	TArray<AActor*> allRetreatingCovers = FindAllRetreatingCovers(pos, forward);
+	int32 id = GetCoverId(cover);
+	const ACoverObject* coverObject = Cast<ACoverObject>(cover);
+	if (id == INDEX_NONE || coverObject == nullptr || !coverObject->CoverPoints.IsValidIndex(pointIndex))
+	{
+		return;
+	}
 
-	//If there are no valid covers return cover AI is already in so they stay put
-	if (allRetreatingCovers.Num() == 0)
+	const bool enabled = coverObject->CoverPoints[pointIndex].Enabled;
+	const int32 firstBox = GetCoverPointFirstBox(id, coverObject);
+	if (firstBox != INDEX_NONE)
 	{
-		return coverAIIsIn;
+		CoverPointBVH.SetEnabled(firstBox + pointIndex, enabled);
 	}
-	//Calculate each covers distance to the AI and pick the closest one
-	else
+
+	//A cover with no sides left stays in the grid, every query skips it with one bit test so nothing cached has to be thrown away
+	DisabledCovers[id] = coverObject->IsCoverDisabled();
+	UpdateCoverExposure(id);
+	if (!enabled)
 	{
-		//If there is only one cover return that = no distance competition
-		if (allRetreatingCovers.Num() == 1)
-		{
-			return allRetreatingCovers[0];
-		}
-		else
-		{
-			FVector coverLoc = allRetreatingCovers[0]->GetActorLocation();
-			int currentWinner = 0;
-			float currentClosestDistance = (coverLoc - pos).Size();
-			float tmpDistance;
+		//The side the AI was heading for may be the one that went, it is told either way but only loses the cover if there is nothing left of it
+		NotifyCoverHolder(id, DisabledCovers[id]);
+	}
+}
+
+void AAIDirector::UpdateCoverExposure(AActor * cover)
+{
+	int32 id = GetCoverId(cover);
+	if (id != INDEX_NONE)
+	{
+		UpdateCoverExposure(id);
+	}
+}
+
+bool AAIDirector::IsHighCover(AActor * cover) const
+{
+	const int32 id = GetCoverId(cover);
+	return id != INDEX_NONE && HighCovers[id];
+}
 
-			//For all normal covers, calculate distance, make it the winner if it is further
-			for (int i = 1; i < allRetreatingCovers.Num(); i++)
+void AAIDirector::UpdateCoverExposure(int32 id)
+{
+	const int32 numSectors = FCoverPoint::NumExposureSectors;
+	uint8* exposure = CoverExposure.GetData() + id * numSectors;
+	HighCovers[id] = false;
+
+	//Covers that are not cover objects, or have no points, are treated as open all round
+	const ACoverObject* coverObject = Cast<ACoverObject>(CoverTable[id]);
+	FMemory::Memset(exposure, 255, numSectors);
+	if (coverObject)
+	{
+		for (const FCoverPoint& point : coverObject->CoverPoints)
+		{
+			if (!point.Enabled)
 			{
-				coverLoc = allRetreatingCovers[i]->GetActorLocation();
-				tmpDistance = (coverLoc - pos).Size();
-				if (tmpDistance < currentClosestDistance)
-				{
-					currentClosestDistance = tmpDistance;
-					currentWinner = i;
-				}
+				continue;
+			}
+			HighCovers[id] = HighCovers[id] || point.Height == CoverHeights::HighCover;
+			//The world direction at the middle of each sector, looked up in the point's own sectors
+			for (int32 sector = 0; sector < numSectors; sector++)
+			{
+				const float angle = (sector + 0.5f) * 2.f * PI / numSectors - PI;
+				const FVector direction(FMath::Cos(angle), FMath::Sin(angle), 0.f);
+				exposure[sector] = FMath::Min<uint8>(exposure[sector], (uint8)FMath::RoundToInt(point.GetExposure(direction) * 255.f));
 			}
-			return allRetreatingCovers[currentWinner];
 		}
 	}
+	CoverExposureSnapshot.Reset();
 }
 
-AActor * AAIDirector::GetAdvancingCover(FVector pos, FVector forward, AActor * coverAIIsIn)
+void AAIDirector::NotifyCoverHolder(int32 id, bool release)
 {
-	TArray<AActor*> allAdvancingCovers = FindAllAdvancingCovers(pos, forward);
+	if (!ReservedCovers[id])
+	{
+		return;
+	}
+	AActor* owner = CoverOwners[id].Get();
+	if (release)
+	{
+		ReleaseCoverId(id);
+	}
+	if (owner == nullptr)
+	{
+		return;
+	}
 
-	//If there are no valid covers return cover AI is already in so they stay put
-	if (allAdvancingCovers.Num() == 0)
+	//Counts as the agent's report, so its own cover check does not send it again
+	const int32 index = Agents.Find(Cast<APawn>(owner));
+	if (index != INDEX_NONE)
 	{
-		return coverAIIsIn;
+		AgentInvalidatedCovers[index] = CoverTable[id];
 	}
-	//Calculate each covers distance to the AI and pick the closest one
-	else
+	OnCoverInvalidated.Broadcast(owner, CoverTable[id]);
+}
+
+void AAIDirector::InvalidateCandidateCachesNear(const FVector& location)
+{
+	for (FCoverCandidateCache& cache : CandidateCaches)
 	{
-		//If there is only one cover return that = no distance competition
-		if (allAdvancingCovers.Num() == 1)
+		if (!cache.Candidates.IsValid())
 		{
-			return allAdvancingCovers[0];
+			continue;
 		}
-		else
+		//The same widened band the cache was built with, only a cache whose band holds the location can have had the cover or be missing it
+		const float halfDiagonal = 0.5f * cache.CellSize * FMath::Sqrt(3.f);
+		const FVector cellCenter = (FVector(cache.PlayerCell) + FVector(0.5f)) * cache.CellSize;
+		const float distance = (location - cellCenter).Size();
+		if (distance > cache.MinDistance - halfDiagonal && distance < cache.MaxDistance + halfDiagonal)
 		{
-			FVector coverLoc = allAdvancingCovers[0]->GetActorLocation();
-			int currentWinner = 0;
-			float currentClosestDistance = (coverLoc - pos).Size();
-			float tmpDistance;
-
-			//For all normal covers, calculate distance, make it the winner if it is further
-			for (int i = 1; i < allAdvancingCovers.Num(); i++)
-			{
-				coverLoc = allAdvancingCovers[i]->GetActorLocation();
-				tmpDistance = (coverLoc - pos).Size();
-				if (tmpDistance < currentClosestDistance)
-				{
-					currentClosestDistance = tmpDistance;
-					currentWinner = i;
-				}
-			}
-			return allAdvancingCovers[currentWinner];
+			cache.Candidates.Reset();
 		}
 	}
 }
 
+//RESERVATIONS
+int32 AAIDirector::GetCoverId(AActor * cover) const
+{
+	const int32* id = CoverIds.Find(cover);
+	return id ? *id : INDEX_NONE;
+}
 
-AActor * AAIDirector::GetCover(FVector pos, FVector forward, AActor * coverAIIsIn, MovementTypes movementType)
+bool AAIDirector::ReserveCoverId(int32 id, AActor * owner)
 {
-	AActor* tmpCover;
-	if (coverAIIsIn)
+	if (ReservedCovers[id])
 	{
-		//Only add back cover if it is valid
-		AllCovers.Add(coverAIIsIn);
+		return false;
 	}
-	else
+	ReservedCovers[id] = true;
+	CoverOwners[id] = owner;
+	CoverLeaseExpiryTimes[id] = CoverLeaseDuration > 0.f ? GetWorld()->GetTimeSeconds() + CoverLeaseDuration : 0.f;
+	return true;
+}
+
+void AAIDirector::ReleaseCoverId(int32 id)
+{
+	ReservedCovers[id] = false;
+	CoverOwners[id] = nullptr;
+	CoverLeaseExpiryTimes[id] = 0.f;
+}
+
+bool AAIDirector::ReserveCover(AActor * cover, AActor * owner)
+{
+	int32 id = GetCoverId(cover);
+	return id != INDEX_NONE && ReserveCoverId(id, owner);
+}
+
+void AAIDirector::ReleaseCover(AActor * cover)
+{
+	int32 id = GetCoverId(cover);
+	if (id != INDEX_NONE)
 	{
-		//If there is no valid cover, as in AI's first choice, then get closest cover
-		coverAIIsIn = GetClosestCover(pos);
+		ReleaseCoverId(id);
 	}
-	//Switch on all four types, for each get and then return most appropriate cover of wanted type, then remove that cover from array of all covers
-	switch (movementType)
+}
+
+void AAIDirector::ReleaseCoversOwnedBy(AActor * owner)
+{
+	for (TConstSetBitIterator<> it(ReservedCovers); it; ++it)
 	{
-	case MovementTypes::Normal:
-		tmpCover = GetNormalCover(pos, coverAIIsIn);
-		AllCovers.Remove(tmpCover);
-		return tmpCover;
-	case MovementTypes::Advancing:
-		tmpCover = GetAdvancingCover(pos, forward, coverAIIsIn);
-		AllCovers.Remove(tmpCover);
-		return tmpCover;
-	case MovementTypes::Flanking:
-		tmpCover = GetFlankingCover(pos, coverAIIsIn);
-		AllCovers.Remove(tmpCover);
-		return tmpCover;
-	case MovementTypes::Retreating:
-		tmpCover = GetRetreatingCover(pos, forward, coverAIIsIn);
-		AllCovers.Remove(tmpCover);
-		return tmpCover;
-	default:
-		return coverAIIsIn;
+		if (CoverOwners[it.GetIndex()] == owner)
+		{
+			ReleaseCoverId(it.GetIndex());
+		}
 	}
 }
 
-// Called when the game starts or when spawned
-void AAIDirector::BeginPlay()
+bool AAIDirector::IsCoverReserved(AActor * cover) const
 {
-	Super::BeginPlay();
+	int32 id = GetCoverId(cover);
+	return id != INDEX_NONE && IsCoverIdReserved(id);
 }
 
-// Called every frame
-void AAIDirector::Tick(float DeltaTime)
+AActor * AAIDirector::GetCoverOwner(AActor * cover) const
 {
-	Super::Tick(DeltaTime);
+	int32 id = GetCoverId(cover);
+	return id != INDEX_NONE && IsCoverIdReserved(id) ? CoverOwners[id].Get() : nullptr;
+}
+
+void AAIDirector::ReleaseExpiredReservations()
+{
+	const float now = GetWorld()->GetTimeSeconds();
+	//Only the reserved covers are visited
+	for (TConstSetBitIterator<> it(ReservedCovers); it; ++it)
+	{
+		const int32 id = it.GetIndex();
+		//Stale means the owner was set but has since been destroyed, i.e. the AI died
+		const bool ownerGone = CoverOwners[id].IsStale();
+		const bool leaseExpired = CoverLeaseExpiryTimes[id] > 0.f && now >= CoverLeaseExpiryTimes[id];
+		if (ownerGone || leaseExpired)
+		{
+			ReleaseCoverId(id);
+		}
+	}
+}
+
+//DANGER
+void AAIDirector::AddDanger(FVector location, float radius, float amount)
+{
+	InfluenceMap.Stamp(location, radius, amount);
+}
 
+void AAIDirector::ReportShot(FVector impactLocation)
+{
+	InfluenceMap.Stamp(impactLocation, ShotDangerRadius, ShotDanger);
 }
 
+void AAIDirector::ReportDeath(FVector location)
+{
+	InfluenceMap.Stamp(location, DeathDangerRadius, DeathDanger);
+}
+
+float AAIDirector::GetDanger(FVector location) const
+{
+	return InfluenceMap.Sample(location);
+}
+
+//AGENTS
+void AAIDirector::RegisterAgent(APawn * agent)
+{
+	if (agent == nullptr || Agents.Contains(agent))
+	{
+		return;
+	}
+	Agents.Add(agent);
+	AgentCanSeeThreat.Add(false);
+	//Spread first checks over one interval so enemies spawned together are not all checked on the same frame
+	AgentNextRefreshTimes.Add(GetWorld()->GetTimeSeconds() + FMath::FRand() * AgentRefreshInterval);
+	AgentInvalidatedCovers.Add(nullptr);
+}
+
+void AAIDirector::UnregisterAgent(APawn * agent)
+{
+	int32 index = Agents.Find(agent);
+	if (index == INDEX_NONE)
+	{
+		return;
+	}
+	Agents.RemoveAtSwap(index);
+	AgentCanSeeThreat.RemoveAtSwap(index);
+	AgentNextRefreshTimes.RemoveAtSwap(index);
+	AgentInvalidatedCovers.RemoveAtSwap(index);
+}
+
+bool AAIDirector::CanAgentSeeThreat(APawn * agent) const
+{
+	int32 index = Agents.Find(agent);
+	return index != INDEX_NONE && AgentCanSeeThreat[index];
+}
+
+AActor * AAIDirector::GetInvalidatedCover(APawn * agent) const
+{
+	int32 index = Agents.Find(agent);
+	return index != INDEX_NONE ? AgentInvalidatedCovers[index] : nullptr;
+}
+
+float AAIDirector::GetAgentPriority(int32 agentIndex) const
+{
+	const FVector location = Agents[agentIndex]->GetActorLocation();
+	const int32 threat = GetNearestThreatIndex(location);
+	if (threat == INDEX_NONE)
+	{
+		return 0.f;
+	}
+
+	//1 next to a player falling to 0 at twice the furthest cover distance, plus 1 if a player can be seen
+	const float distance = (FVector(ThreatX[threat], ThreatY[threat], ThreatZ[threat]) - location).Size();
+	const float nearness = 1.f - FMath::Min(distance / FMath::Max(2.f * MaxDistanceAwayFromPlayer, 1.f), 1.f);
+	return nearness + (AgentCanSeeThreat[agentIndex] ? 1.f : 0.f);
+}
+
+void AAIDirector::ScheduleAgentWork()
+{
+	const float now = GetWorld()->GetTimeSeconds();
+	for (int i = 0; i < Agents.Num(); i++)
+	{
+		APawn* agent = Agents[i];
+		if (agent == nullptr || now < AgentNextRefreshTimes[i])
+		{
+			continue;
+		}
+		AgentNextRefreshTimes[i] = now + AgentRefreshInterval;
+
+		//The agent may be gone by the time the work runs
+		const float priority = GetAgentPriority(i);
+		TWeakObjectPtr<APawn> weakAgent = agent;
+		Scheduler.Enqueue(MakeWorkKey(EDirectorWork::LineOfSight, agent), priority, [this, weakAgent]()
+		{
+			if (weakAgent.IsValid())
+			{
+				RefreshAgentLineOfSight(weakAgent.Get());
+			}
+		});
+		Scheduler.Enqueue(MakeWorkKey(EDirectorWork::CoverCheck, agent), priority, [this, weakAgent]()
+		{
+			if (weakAgent.IsValid())
+			{
+				ReevaluateAgentCover(weakAgent.Get());
+			}
+		});
+	}
+}
+
+void AAIDirector::RefreshAgentLineOfSight(APawn * agent)
+{
+	int32 index = Agents.Find(agent);
+	if (index == INDEX_NONE)
+	{
+		return;
+	}
+
+	RefreshThreats();
+	const int32 threat = SelectThreatIndex(agent->GetActorLocation(), agent->GetActorForwardVector());
+	if (threat == INDEX_NONE)
+	{
+		AgentCanSeeThreat[index] = false;
+		return;
+	}
+
+	FCollisionQueryParams params(FName(TEXT("AgentLineOfSight")), false, agent);
+	params.AddIgnoredActor(Threats[threat]);
+	AgentCanSeeThreat[index] = !GetWorld()->LineTraceTestByChannel(agent->GetPawnViewLocation(), Threats[threat]->GetPawnViewLocation(), ECC_Visibility, params);
+}
+
+void AAIDirector::ReevaluateAgentCover(APawn * agent)
+{
+	int32 index = Agents.Find(agent);
+	if (index == INDEX_NONE)
+	{
+		return;
+	}
+
+	//Only the reserved covers are visited to find the agent's
+	int32 id = INDEX_NONE;
+	for (TConstSetBitIterator<> it(ReservedCovers); it; ++it)
+	{
+		if (CoverOwners[it.GetIndex()] == agent)
+		{
+			id = it.GetIndex();
+			break;
+		}
+	}
+	if (id == INDEX_NONE)
+	{
+		return;
+	}
+
+	//Run the same kernel the queries use on just this cover, it is invalid if it is no longer in any movement type's band
+	const FCoverScoringInput input = MakeScoringInput(agent->GetActorLocation(), agent->GetActorForwardVector());
+	const FVector location = CoverTable[id]->GetActorLocation();
+	uint8 mask;
+	float distanceToAI;
+	CoverScoring::ScoreCovers(input, &location.X, &location.Y, &location.Z, 1, &mask, &distanceToAI);
+	if (mask != ECoverScoringMask::None && !DisabledCovers[id] && !IsCoverIdExposed(id))
+	{
+		AgentInvalidatedCovers[index] = nullptr;
+		return;
+	}
+
+	//Reported once, the agent's behaviour decides when to move
+	if (AgentInvalidatedCovers[index] != CoverTable[id])
+	{
+		AgentInvalidatedCovers[index] = CoverTable[id];
+		OnCoverInvalidated.Broadcast(agent, CoverTable[id]);
+	}
+}
+
+APawn * AAIDirector::FindAgentAt(const FVector & pos) const
+{
+	//Callers pass the AI's own location, so anything further than this is somebody else
+	const float AgentMatchDistance = 100.f;
+	APawn* closest = nullptr;
+	float closestDistanceSquared = AgentMatchDistance * AgentMatchDistance;
+	for (APawn* agent : Agents)
+	{
+		if (agent == nullptr)
+		{
+			continue;
+		}
+		const float distanceSquared = FVector::DistSquared(agent->GetActorLocation(), pos);
+		if (distanceSquared <= closestDistanceSquared)
+		{
+			closestDistanceSquared = distanceSquared;
+			closest = agent;
+		}
+	}
+	return closest;
+}
+
+//THREATS
+void AAIDirector::RegisterThreat(APawn * threat)
+{
+	if (threat)
+	{
+		Threats.AddUnique(threat);
+		//Picked up straight away rather than next frame
+		ThreatsRefreshedFrame = MAX_uint64;
+	}
+}
+
+void AAIDirector::UnregisterThreat(APawn * threat)
+{
+	if (Threats.Remove(threat) > 0)
+	{
+		ThreatsRefreshedFrame = MAX_uint64;
+	}
+}
+
+void AAIDirector::RefreshThreats()
+{
+	if (ThreatsRefreshedFrame == GFrameCounter)
+	{
+		return;
+	}
+	ThreatsRefreshedFrame = GFrameCounter;
+
+	Threats.RemoveAll([](APawn* threat) { return threat == nullptr || threat->IsPendingKill(); });
+	const int32 num = Threats.Num();
+	ThreatX.SetNumUninitialized(num);
+	ThreatY.SetNumUninitialized(num);
+	ThreatZ.SetNumUninitialized(num);
+	ThreatVelocityX.SetNumUninitialized(num);
+	ThreatVelocityY.SetNumUninitialized(num);
+	ThreatVelocityZ.SetNumUninitialized(num);
+	ThreatForwardX.SetNumUninitialized(num);
+	ThreatForwardY.SetNumUninitialized(num);
+	ThreatForwardZ.SetNumUninitialized(num);
+	ThreatCoverPoints.SetNumUninitialized(num);
+	CandidateCaches.SetNum(num);
+	AnyThreatInBakedCover = false;
+
+	for (int i = 0; i < num; i++)
+	{
+		const APawn* threat = Threats[i];
+		const FVector location = threat->GetActorLocation();
+		const FVector velocity = threat->GetVelocity();
+		const FVector forward = threat->GetActorForwardVector();
+		ThreatX[i] = location.X;
+		ThreatY[i] = location.Y;
+		ThreatZ[i] = location.Z;
+		ThreatVelocityX[i] = velocity.X;
+		ThreatVelocityY[i] = velocity.Y;
+		ThreatVelocityZ[i] = velocity.Z;
+		ThreatForwardX[i] = forward.X;
+		ThreatForwardY[i] = forward.Y;
+		ThreatForwardZ[i] = forward.Z;
+
+		ThreatCoverPoints[i] = INDEX_NONE;
+		const AGunslingersCharacter* playerCharacter = Cast<AGunslingersCharacter>(threat);
+		if (RejectExposedCovers && CoverLevelData && playerCharacter)
+		{
+			ThreatCoverPoints[i] = CoverLevelData->GetCoverPointIndex(playerCharacter->GetCurrentCover());
+			AnyThreatInBakedCover |= ThreatCoverPoints[i] != INDEX_NONE;
+		}
+
+		UpdateCandidateCache(CandidateCaches[i], location);
+	}
+}
+
+int32 AAIDirector::GetNearestThreatIndex(const FVector& pos) const
+{
+	int32 nearest = INDEX_NONE;
+	float nearestDistanceSquared = MAX_flt;
+	for (int i = 0; i < ThreatX.Num(); i++)
+	{
+		const float distanceSquared = FMath::Square(ThreatX[i] - pos.X) + FMath::Square(ThreatY[i] - pos.Y) + FMath::Square(ThreatZ[i] - pos.Z);
+		if (distanceSquared < nearestDistanceSquared)
+		{
+			nearestDistanceSquared = distanceSquared;
+			nearest = i;
+		}
+	}
+	return nearest;
+}
+
+int32 AAIDirector::SelectThreatIndex(const FVector& pos, const FVector& forward) const
+{
+	if (ThreatSelection != ThreatSelectionTypes::MostDangerousThreat)
+	{
+		return GetNearestThreatIndex(pos);
+	}
+
+	//A threat is more dangerous the closer it will be shortly and the more directly it is looking at the AI
+	int32 mostDangerous = INDEX_NONE;
+	float highestDanger = -1.f;
+	for (int i = 0; i < ThreatX.Num(); i++)
+	{
+		const FVector predictedLocation(ThreatX[i] + ThreatVelocityX[i] * ThreatPredictionTime, ThreatY[i] + ThreatVelocityY[i] * ThreatPredictionTime, ThreatZ[i] + ThreatVelocityZ[i] * ThreatPredictionTime);
+		const FVector toAI = pos - predictedLocation;
+		const float distance = FMath::Max(toAI.Size(), 1.f);
+		const float facing = (ThreatForwardX[i] * toAI.X + ThreatForwardY[i] * toAI.Y + ThreatForwardZ[i] * toAI.Z) / distance;
+		const float danger = (2.f + facing) / distance;
+		if (danger > highestDanger)
+		{
+			highestDanger = danger;
+			mostDangerous = i;
+		}
+	}
+	return mostDangerous;
+}
+
+APawn * AAIDirector::SelectThreat(FVector pos, FVector forward)
+{
+	RefreshThreats();
+	int32 threat = SelectThreatIndex(pos, forward);
+	return threat != INDEX_NONE ? Threats[threat] : nullptr;
+}
+
+APawn * AAIDirector::GetNearestThreat(FVector pos)
+{
+	RefreshThreats();
+	int32 threat = GetNearestThreatIndex(pos);
+	return threat != INDEX_NONE ? Threats[threat] : nullptr;
+}
+
+FCoverScoringInput AAIDirector::MakeScoringInput(FVector pos, FVector forward)
+{
+	RefreshThreats();
+
+	FCoverScoringInput input;
+	input.AILocation = pos;
+	input.AIForward = forward;
+	input.MinDistanceFromPlayer = MinDistanceAwayFromPlayer;
+	input.MaxDistanceFromPlayer = MaxDistanceAwayFromPlayer;
+	input.Influence = DangerCost != 0.f ? &InfluenceMap : nullptr;
+	input.DangerCost = DangerCost;
+	input.CoverExposure = ExposureCost != 0.f ? CoverExposure.GetData() : nullptr;
+	input.ExposureCost = ExposureCost;
+
+	const int32 threat = SelectThreatIndex(pos, forward);
+	if (threat == INDEX_NONE)
+	{
+		//Nobody to take cover from, so no cover is valid and the AI stays put
+		input.MaxDistanceFromPlayer = 0.f;
+		return input;
+	}
+	input.PlayerLocation = FVector(ThreatX[threat], ThreatY[threat], ThreatZ[threat]);
+	input.PlayerForward = FVector(ThreatForwardX[threat], ThreatForwardY[threat], ThreatForwardZ[threat]);
+	for (int i = 0; i < ThreatX.Num(); i++)
+	{
+		if (i != threat)
+		{
+			input.OtherThreatX.Add(ThreatX[i]);
+			input.OtherThreatY.Add(ThreatY[i]);
+			input.OtherThreatZ.Add(ThreatZ[i]);
+		}
+	}
+	return input;
+}
+
+void AAIDirector::UpdateCandidateCache(FCoverCandidateCache& cache, const FVector& playerLocation)
+{
+	if (CVarCoverCandidateCache.GetValueOnGameThread() == 0)
+	{
+		cache.Candidates.Reset();
+		return;
+	}
+
+	const float cellSize = FMath::Max(CandidateCacheCellSize, 1.f);
+	const FIntVector playerCell(FMath::FloorToInt(playerLocation.X / cellSize), FMath::FloorToInt(playerLocation.Y / cellSize), FMath::FloorToInt(playerLocation.Z / cellSize));
+	if (cache.Candidates.IsValid() && cache.PlayerCell == playerCell && cache.CellSize == cellSize
+		&& cache.MinDistance == MinDistanceAwayFromPlayer && cache.MaxDistance == MaxDistanceAwayFromPlayer)
+	{
+		return;
+	}
+	INC_DWORD_STAT(STAT_CoverCandidateCacheRebuilds);
+
+	//Any player position in the cell is within half the cell's diagonal of its centre, so widening the band by that much catches every cover that could be valid from anywhere in it
+	const float halfDiagonal = 0.5f * cellSize * FMath::Sqrt(3.f);
+	const FVector cellCenter = (FVector(playerCell) + FVector(0.5f)) * cellSize;
+	const float minRadius = MinDistanceAwayFromPlayer - halfDiagonal;
+	const float maxRadius = MaxDistanceAwayFromPlayer + halfDiagonal;
+
+	TSharedRef<FCoverGridCell, ESPMode::ThreadSafe> candidates = MakeShared<FCoverGridCell, ESPMode::ThreadSafe>();
+	CoverGrid.ForEachCellInAnnulus(cellCenter, minRadius, maxRadius, [&](const FCoverGridCell& cell)
+	{
+		for (int i = 0; i < cell.Num(); i++)
+		{
+			const float distance = (cell.GetLocation(i) - cellCenter).Size();
+			if (distance > minRadius && distance < maxRadius)
+			{
+				candidates->Add(cell.Ids[i], cell.GetLocation(i), cell.GetForward(i));
+			}
+		}
+	});
+
+	cache.PlayerCell = playerCell;
+	cache.CellSize = cellSize;
+	cache.MinDistance = MinDistanceAwayFromPlayer;
+	cache.MaxDistance = MaxDistanceAwayFromPlayer;
+	cache.Candidates = candidates;
+}
+
+TSharedPtr<const FCoverGridCell, ESPMode::ThreadSafe> AAIDirector::GetCachedCandidates(const FCoverScoringInput& input) const
+{
+	const FVector& playerLocation = input.PlayerLocation;
+	for (const FCoverCandidateCache& cache : CandidateCaches)
+	{
+		if (!cache.Candidates.IsValid() || cache.MinDistance != input.MinDistanceFromPlayer || cache.MaxDistance != input.MaxDistanceFromPlayer)
+		{
+			continue;
+		}
+		const FIntVector playerCell(FMath::FloorToInt(playerLocation.X / cache.CellSize), FMath::FloorToInt(playerLocation.Y / cache.CellSize), FMath::FloorToInt(playerLocation.Z / cache.CellSize));
+		if (playerCell == cache.PlayerCell)
+		{
+			INC_DWORD_STAT(STAT_CoverCandidateCacheHits);
+			return cache.Candidates;
+		}
+	}
+	//Counted per query, so hits over hits and misses is how often a query skipped walking the grid
+	INC_DWORD_STAT(STAT_CoverCandidateCacheMisses);
+	return nullptr;
+}
+
+bool AAIDirector::IsCoverIdExposed(int32 id) const
+{
+	//Without a baked answer the cover is assumed to protect the AI, like before the bake existed
+	if (!AnyThreatInBakedCover || CoverBakedIndices[id] == INDEX_NONE)
+	{
+		return false;
+	}
+	for (int32 coverPoint : ThreatCoverPoints)
+	{
+		if (coverPoint != INDEX_NONE && CoverLevelData->IsCoverObjectExposedTo(CoverBakedIndices[id], coverPoint))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void AAIDirector::ScoreCoverCell(const FCoverGridCell& cell, const FCoverScoringInput& input, TFunctionRef<bool(int32)> isAvailable, TFunctionRef<void(int32, uint8, float, float)> visitor)
+{
+	TArray<uint8, TInlineAllocator<64>> masks;
+	TArray<float, TInlineAllocator<64>> distancesToAI;
+
+	const int32 num = cell.Num();
+	masks.SetNumUninitialized(num, false);
+	distancesToAI.SetNumUninitialized(num, false);
+	CoverScoring::ScoreCovers(input, cell.X.GetData(), cell.Y.GetData(), cell.Z.GetData(), num, masks.GetData(), distancesToAI.GetData());
+
+	for (int i = 0; i < num; i++)
+	{
+		if (masks[i] != ECoverScoringMask::None && isAvailable(cell.Ids[i]))
+		{
+			//One lookup per cover that passed, instead of tracing to see if it is under fire
+			float dangerCost = input.Influence ? input.DangerCost * input.Influence->Sample(cell.GetLocation(i)) : 0.f;
+			//And one for how open the cover is on the side facing the player
+			if (input.CoverExposure)
+			{
+				const int32 sector = FCoverPoint::GetExposureSector(input.PlayerLocation - cell.GetLocation(i));
+				dangerCost += input.ExposureCost * input.CoverExposure[cell.Ids[i] * FCoverPoint::NumExposureSectors + sector] / 255.f;
+			}
+			visitor(cell.Ids[i], masks[i], distancesToAI[i], dangerCost);
+		}
+	}
+}
+
+void AAIDirector::ScoreCoversInBand(const FCoverSpatialGrid& grid, const FCoverGridCell* cachedCandidates, const FCoverScoringInput& input, TFunctionRef<bool(int32)> isAvailable, TFunctionRef<void(int32, uint8, float, float)> visitor)
+{
+	//The cached candidates are already in grid order, so ties are won by the same cover either way
+	if (cachedCandidates)
+	{
+		ScoreCoverCell(*cachedCandidates, input, isAvailable, visitor);
+		return;
+	}
+
+	//The grid only returns cells that can hold covers that are not too far that it would cause the AI to have to advance, or too close that they would have to retreat
+	grid.ForEachCellInAnnulus(input.PlayerLocation, input.MinDistanceFromPlayer, input.MaxDistanceFromPlayer, [&](const FCoverGridCell& cell)
+	{
+		ScoreCoverCell(cell, input, isAvailable, visitor);
+	});
+}
+
+void AAIDirector::ScoreCoversInBand(const FCoverScoringInput& input, TFunctionRef<void(int32, uint8, float, float)> visitor) const
+{
+	//Taken covers are skipped with a single bit test, covers the player can see into with a few more
+	ScoreCoversInBand(CoverGrid, GetCachedCandidates(input).Get(), input, [&](int32 id) { return IsCoverIdAvailable(id); }, visitor);
+}
+
+TArray<AActor*> AAIDirector::CollectCovers(const FCoverScoringInput& input, uint8 typeMask) const
+{
+	TArray<AActor*> covers;
+	ScoreCoversInBand(input, [&](int32 id, uint8 mask, float distanceToAI, float dangerCost)
+	{
+		if (mask & typeMask)
+		{
+			covers.Add(CoverTable[id]);
+		}
+	});
+	return covers;
+}
+
+uint8 AAIDirector::GetScoringMask(MovementTypes movementType)
+{
+	switch (movementType)
+	{
+	case MovementTypes::Normal:
+		return ECoverScoringMask::Normal;
+	case MovementTypes::Advancing:
+		return ECoverScoringMask::Advancing;
+	case MovementTypes::Flanking:
+		return ECoverScoringMask::Flanking;
+	case MovementTypes::Retreating:
+		return ECoverScoringMask::Retreating;
+	default:
+		return ECoverScoringMask::None;
+	}
+}
+
+void AAIDirector::FindRankedCovers(const FCoverScoringInput& input, const FCoverNavCostRow* travelCosts, MovementTypes movementType, int32 maxCandidates, TArray<int32>& outCoverIds, TArray<float>& outScores) const
+{
+	FindRankedCovers(CoverGrid, GetCachedCandidates(input).Get(), travelCosts, input, [&](int32 id) { return IsCoverIdAvailable(id); }, movementType, maxCandidates, outCoverIds, outScores);
+}
+
+void AAIDirector::FindRankedCovers(const FCoverSpatialGrid& grid, const FCoverGridCell* cachedCandidates, const FCoverNavCostRow* travelCosts, const FCoverScoringInput& input, TFunctionRef<bool(int32)> isAvailable, MovementTypes movementType, int32 maxCandidates, TArray<int32>& outCoverIds, TArray<float>& outScores)
+{
+	const uint8 typeMask = GetScoringMask(movementType);
+	//Flanking prefers the furthest cover from the AI, every other type the closest
+	const bool preferFurthest = movementType == MovementTypes::Flanking;
+
+	ScoreCoversInBand(grid, cachedCandidates, input, isAvailable, [&](int32 id, uint8 mask, float distanceToAI, float dangerCost)
+	{
+		if ((mask & typeMask) == 0)
+		{
+			return;
+		}
+
+		const float distance = GetRankingDistance(travelCosts, id, distanceToAI);
+		if (distance == FCoverNavCostRow::Unreachable)
+		{
+			return;
+		}
+
+		//Lower score is better, insert after any equal score so the first cover found wins ties like in GetCover. Danger makes a cover worse whichever way distance is preferred
+		float score = (preferFurthest ? -distance : distance) + dangerCost;
+		int32 insertAt = outScores.Num();
+		while (insertAt > 0 && score < outScores[insertAt - 1])
+		{
+			insertAt--;
+		}
+		if (insertAt >= maxCandidates)
+		{
+			return;
+		}
+		outScores.Insert(score, insertAt);
+		outCoverIds.Insert(id, insertAt);
+		if (outScores.Num() > maxCandidates)
+		{
+			outScores.Pop(false);
+			outCoverIds.Pop(false);
+		}
+	});
+}
+
+void AAIDirector::AssignCovers(const TArray<TArray<int32>>& candidates, const TArray<TArray<float>>& scores, TFunctionRef<bool(int32)> isAvailable, TArray<int32>& outCoverIds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CoverSquadAssignment);
+
+	//Costs are how much worse each cover is than the AI's best, so AI going for different movement types can be compared
+	FCoverAssignmentProblem& problem = AssignmentProblem;
+	problem.Reset();
+	problem.UnassignedCost = SquadStayPutCost;
+	for (int i = 0; i < candidates.Num(); i++)
+	{
+		problem.AddAgent();
+		for (int c = 0; c < candidates[i].Num(); c++)
+		{
+			if (isAvailable(candidates[i][c]))
+			{
+				problem.AddCandidate(candidates[i][c], scores[i][c] - scores[i][0]);
+			}
+		}
+	}
+
+	if (CVarCoverSquadAssignment.GetValueOnGameThread() != 0)
+	{
+		if (CoverAssignment::SolveAuction(problem, SquadAssignmentEpsilon, SquadAssignmentTimeBudget / 1000.0, outCoverIds))
+		{
+			return;
+		}
+		//Past the time budget the batch is handed out in request order, so a big batch can never hitch the frame
+		INC_DWORD_STAT(STAT_CoverSquadAssignmentTimeouts);
+	}
+	CoverAssignment::SolveGreedy(problem, outCoverIds);
+}
+
+//FIND ALL
+TArray<AActor*> AAIDirector::FindAllFlankingCovers(FVector pos, FVector forward)
+{
+	//Flanking covers are in range and behind the player, the AI's position only decides which player that is
+	return CollectCovers(MakeScoringInput(pos, forward), ECoverScoringMask::Flanking);
+}
+
+TArray<AActor*> AAIDirector::FindAllNormalCovers(FVector pos)
+{
+	//Normal covers are in range and within 800 units of the AI
+	return CollectCovers(MakeScoringInput(pos, FVector::ZeroVector), ECoverScoringMask::Normal);
+}
+
+TArray<AActor*> AAIDirector::FindAllRetreatingCovers(FVector pos, FVector forward)
+{
+	//Retreating covers are in range and behind the AI
+	return CollectCovers(MakeScoringInput(pos, forward), ECoverScoringMask::Retreating);
+}
+
+TArray<AActor*> AAIDirector::FindAllAdvancingCovers(FVector pos, FVector forward)
+{
+	//Advancing covers are in range, not behind the AI, and on the same side of the player as the AI
+	return CollectCovers(MakeScoringInput(pos, forward), ECoverScoringMask::Advancing);
+}
+
+
+//GET COVERS
+AActor * AAIDirector::GetFlankingCover(FVector pos, AActor * coverAIIsIn)
+{
+	//Ranked the same way as GetCover and the batched queries, by path cost with danger and exposure taken into account. The furthest away makes the best flanking cover
+	return GetCoverOptions(pos, FVector::ZeroVector, coverAIIsIn).Flanking;
+}
+
+AActor * AAIDirector::GetNormalCover(FVector pos, AActor * coverAIIsIn)
+{
+	//The closest cover once danger and exposure are counted, or the cover AI is already in if there are none
+	return GetCoverOptions(pos, FVector::ZeroVector, coverAIIsIn).Normal;
+}
+
+AActor * AAIDirector::GetRetreatingCover(FVector pos, FVector forward, AActor * coverAIIsIn)
+{
+	return GetCoverOptions(pos, forward, coverAIIsIn).Retreating;
+}
+
+AActor * AAIDirector::GetAdvancingCover(FVector pos, FVector forward, AActor * coverAIIsIn)
+{
+	return GetCoverOptions(pos, forward, coverAIIsIn).Advancing;
+}
+
+
+FCoverOptions AAIDirector::GetCoverOptions(FVector pos, FVector forward, AActor * coverAIIsIn)
+{
+	//Flanking picks the furthest cover from the AI, every other type picks the closest
+	int32 normalId = INDEX_NONE;
+	int32 flankingId = INDEX_NONE;
+	int32 advancingId = INDEX_NONE;
+	int32 retreatingId = INDEX_NONE;
+	float closestNormalDistance = MAX_flt;
+	//Danger and exposure can make furtherness negative, those covers are still ranked rather than dropped
+	float furthestFlankingDistance = -MAX_flt;
+	float closestAdvancingDistance = MAX_flt;
+	float closestRetreatingDistance = MAX_flt;
+
+	//Path costs from the cover AI is in, straight line distance is used for any cover without one
+	TSharedPtr<const FCoverNavCostRow, ESPMode::ThreadSafe> travelCosts = NavCosts.GetRow(GetCoverId(coverAIIsIn));
+	ScoreCoversInBand(MakeScoringInput(pos, forward), [&](int32 id, uint8 mask, float distanceToAI, float dangerCost)
+	{
+		distanceToAI = GetRankingDistance(travelCosts.Get(), id, distanceToAI);
+		if (distanceToAI == FCoverNavCostRow::Unreachable)
+		{
+			return;
+		}
+		//Dangerous covers count as further away, or closer for flanking
+		const float closeness = distanceToAI + dangerCost;
+		const float furtherness = distanceToAI - dangerCost;
+		if ((mask & ECoverScoringMask::Normal) && closeness < closestNormalDistance)
+		{
+			closestNormalDistance = closeness;
+			normalId = id;
+		}
+		if ((mask & ECoverScoringMask::Flanking) && furtherness > furthestFlankingDistance)
+		{
+			furthestFlankingDistance = furtherness;
+			flankingId = id;
+		}
+		if ((mask & ECoverScoringMask::Advancing) && closeness < closestAdvancingDistance)
+		{
+			closestAdvancingDistance = closeness;
+			advancingId = id;
+		}
+		if ((mask & ECoverScoringMask::Retreating) && closeness < closestRetreatingDistance)
+		{
+			closestRetreatingDistance = closeness;
+			retreatingId = id;
+		}
+	});
+
+	//If there are no valid covers of a type return cover AI is already in so they stay put
+	FCoverOptions options;
+	options.Normal = normalId != INDEX_NONE ? CoverTable[normalId] : coverAIIsIn;
+	options.Flanking = flankingId != INDEX_NONE ? CoverTable[flankingId] : coverAIIsIn;
+	options.Advancing = advancingId != INDEX_NONE ? CoverTable[advancingId] : coverAIIsIn;
+	options.Retreating = retreatingId != INDEX_NONE ? CoverTable[retreatingId] : coverAIIsIn;
+	return options;
+}
+
+AActor * AAIDirector::SelectCoverOption(const FCoverOptions & options, MovementTypes movementType)
+{
+	switch (movementType)
+	{
+	case MovementTypes::Normal:
+		return options.Normal;
+	case MovementTypes::Advancing:
+		return options.Advancing;
+	case MovementTypes::Flanking:
+		return options.Flanking;
+	case MovementTypes::Retreating:
+		return options.Retreating;
+	default:
+		return nullptr;
+	}
+}
+
+AActor * AAIDirector::GetCover(FVector pos, FVector forward, AActor * coverAIIsIn, MovementTypes movementType, AActor * requester)
+{
+	AActor* tmpCover;
+	ReleaseExpiredReservations();
+	if (requester == nullptr)
+	{
+		requester = FindAgentAt(pos);
+	}
+	if (coverAIIsIn)
+	{
+		//Only give back cover if it is valid
+		ReleaseCover(coverAIIsIn);
+	}
+	else
+	{
+		//If there is no valid cover, as in AI's first choice, then get closest cover
+		coverAIIsIn = GetClosestCover(pos);
+	}
+	//Score every type in one pass, pick the wanted one, then reserve that cover so no other AI is given it
+	switch (movementType)
+	{
+	case MovementTypes::Normal:
+	case MovementTypes::Advancing:
+	case MovementTypes::Flanking:
+	case MovementTypes::Retreating:
+		tmpCover = SelectCoverOption(GetCoverOptions(pos, forward, coverAIIsIn), movementType);
+		ReserveCover(tmpCover, requester);
+		return tmpCover;
+	default:
+		return coverAIIsIn;
+	}
+}
+
+TArray<AActor*> AAIDirector::GetCoversBatch(const TArray<FCoverRequest>& requests)
+{
+	TArray<AActor*> results;
+	results.SetNumZeroed(requests.Num());
+
+	//Give back every cover the AI are currently in before any scoring, same as GetCover does for a single AI
+	ReleaseExpiredReservations();
+	for (const FCoverRequest& request : requests)
+	{
+		if (request.CurrentCover)
+		{
+			ReleaseCover(request.CurrentCover);
+		}
+	}
+
+	//Threats are picked for every request up front on the game thread, the workers only read the finished inputs
+	TArray<FCoverScoringInput> inputs;
+	inputs.Reserve(requests.Num());
+	for (const FCoverRequest& request : requests)
+	{
+		inputs.Add(MakeScoringInput(request.Position, request.Forward));
+	}
+	const int32 maxCandidates = FMath::Max(BatchCandidatesPerRequest, 1);
+
+	//Each request is scored on its own worker, they only read the grid and reservation table so no locking is needed
+	TArray<TArray<int32>> candidates;
+	TArray<TArray<float>> scores;
+	TArray<AActor*> fallbacks;
+	candidates.SetNum(requests.Num());
+	scores.SetNum(requests.Num());
+	fallbacks.SetNumZeroed(requests.Num());
+	ParallelFor(requests.Num(), [&](int32 i)
+	{
+		const FCoverRequest& request = requests[i];
+		//If there is no valid cover, as in AI's first choice, then fall back to the closest cover
+		fallbacks[i] = request.CurrentCover ? request.CurrentCover : GetClosestCover(request.Position);
+
+		if (GetScoringMask(request.MovementType) != ECoverScoringMask::None)
+		{
+			FindRankedCovers(inputs[i], NavCosts.GetRow(GetCoverId(fallbacks[i])).Get(), request.MovementType, maxCandidates, candidates[i], scores[i]);
+		}
+	});
+
+	TArray<int32> assigned;
+	AssignCovers(candidates, scores, [this](int32 id) { return !IsCoverIdReserved(id); }, assigned);
+	for (int i = 0; i < requests.Num(); i++)
+	{
+		AActor* winner = assigned[i] != INDEX_NONE ? CoverTable[assigned[i]] : fallbacks[i];
+		results[i] = winner;
+		//Unknown movement types leave the AI where it is without taking the cover, like GetCover
+		if (GetScoringMask(requests[i].MovementType) != ECoverScoringMask::None)
+		{
+			ReserveCover(winner, requests[i].Requester ? requests[i].Requester : FindAgentAt(requests[i].Position));
+		}
+	}
+
+	return results;
+}
+
+//ASYNC
+int32 AAIDirector::RequestCoverAsync(const FCoverRequest & request, TFunction<void(AActor*)> onComplete)
+{
+	const int32 requestId = NextCoverRequestId++;
+	FPendingCoverRequest pending;
+	pending.RequestId = requestId;
+	pending.Request = request;
+	pending.Requester = request.Requester;
+	pending.CurrentCover = request.CurrentCover;
+	pending.OnComplete = MoveTemp(onComplete);
+	QueuedCoverRequests.Add(MoveTemp(pending));
+	return requestId;
+}
+
+void AAIDirector::CancelCoverRequest(int32 requestId)
+{
+	QueuedCoverRequests.RemoveAll([requestId](const FPendingCoverRequest& pending) { return pending.RequestId == requestId; });
+	//In flight requests still get scored, they are just not handed a cover
+	for (FPendingCoverRequest& pending : InFlightCoverRequests)
+	{
+		if (pending.RequestId == requestId)
+		{
+			pending.OnComplete = nullptr;
+		}
+	}
+}
+
+void AAIDirector::DispatchCoverRequests()
+{
+	//Give back the covers the AI are in before the snapshot, same as GetCover
+	ReleaseExpiredReservations();
+	for (const FPendingCoverRequest& pending : QueuedCoverRequests)
+	{
+		if (pending.CurrentCover.IsValid())
+		{
+			ReleaseCover(pending.CurrentCover.Get());
+		}
+	}
+
+	//The grid is only copied when covers have registered or unregistered since the last batch, or enough have moved, everything else is small
+	if (!CoverGridSnapshot.IsValid())
+	{
+		CoverGridSnapshot = MakeShared<FCoverSpatialGrid, ESPMode::ThreadSafe>(CoverGrid);
+		CoverMovedSinceSnapshot.Init(false, CoverTable.Num());
+		NumCoversMovedSinceSnapshot = 0;
+	}
+	TSharedRef<FCoverAsyncBatch, ESPMode::ThreadSafe> batch = MakeShared<FCoverAsyncBatch, ESPMode::ThreadSafe>();
+	batch->Grid = CoverGridSnapshot;
+	batch->MaxCandidates = FMath::Max(BatchCandidatesPerRequest, 1);
+	batch->Covers = CoverTable;
+	batch->UnavailableCovers = ReservedCovers;
+	//Covers that have moved since the snapshot would be scored where they used to be
+	for (TConstSetBitIterator<> it(DisabledCovers); it; ++it)
+	{
+		batch->UnavailableCovers[it.GetIndex()] = true;
+	}
+	for (TConstSetBitIterator<> it(CoverMovedSinceSnapshot); it; ++it)
+	{
+		batch->UnavailableCovers[it.GetIndex()] = true;
+	}
+	RefreshThreats();
+	if (AnyThreatInBakedCover)
+	{
+		for (int32 id = 0; id < CoverTable.Num(); id++)
+		{
+			if (IsCoverIdExposed(id))
+			{
+				batch->UnavailableCovers[id] = true;
+			}
+		}
+	}
+
+	//The danger map keeps changing on the game thread, so the worker samples a copy
+	if (DangerCost != 0.f)
+	{
+		batch->Influence = MakeShared<FCoverInfluenceMap, ESPMode::ThreadSafe>(InfluenceMap);
+	}
+	//Exposure only changes when covers do, so the copy is shared between batches until then
+	if (ExposureCost != 0.f)
+	{
+		if (!CoverExposureSnapshot.IsValid())
+		{
+			CoverExposureSnapshot = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>(CoverExposure);
+		}
+		batch->Exposure = CoverExposureSnapshot;
+	}
+
+	InFlightCoverRequests = MoveTemp(QueuedCoverRequests);
+	QueuedCoverRequests.Reset();
+	for (const FPendingCoverRequest& pending : InFlightCoverRequests)
+	{
+		int32 index = batch->Inputs.Add(MakeScoringInput(pending.Request.Position, pending.Request.Forward));
+		batch->Inputs[index].Influence = batch->Influence.Get();
+		batch->Inputs[index].CoverExposure = batch->Exposure.IsValid() ? batch->Exposure->GetData() : nullptr;
+		batch->BandCandidates.Add(GetCachedCandidates(batch->Inputs[index]));
+		//Rows are never changed once built so the worker can share them
+		AActor* fromCover = pending.CurrentCover.IsValid() ? pending.CurrentCover.Get() : GetClosestCover(pending.Request.Position);
+		batch->TravelCosts.Add(NavCosts.GetRow(GetCoverId(fromCover)));
+		batch->Types.Add(pending.Request.MovementType);
+	}
+	batch->Candidates.SetNum(InFlightCoverRequests.Num());
+	batch->Scores.SetNum(InFlightCoverRequests.Num());
+	InFlightBatch = batch;
+
+	InFlightTask = FFunctionGraphTask::CreateAndDispatchWhenReady([batch]()
+	{
+		const FCoverAsyncBatch& snapshot = *batch;
+		for (int i = 0; i < snapshot.Inputs.Num(); i++)
+		{
+			if (GetScoringMask(snapshot.Types[i]) == ECoverScoringMask::None)
+			{
+				continue;
+			}
+			FindRankedCovers(*snapshot.Grid, snapshot.BandCandidates[i].Get(), snapshot.TravelCosts[i].Get(), snapshot.Inputs[i], [&snapshot](int32 id) { return !snapshot.UnavailableCovers[id]; }, snapshot.Types[i], snapshot.MaxCandidates, batch->Candidates[i], batch->Scores[i]);
+		}
+	}, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+}
+
+void AAIDirector::CompleteCoverRequests()
+{
+	TSharedPtr<FCoverAsyncBatch, ESPMode::ThreadSafe> batch = InFlightBatch;
+	TArray<FPendingCoverRequest> requests = MoveTemp(InFlightCoverRequests);
+	InFlightCoverRequests.Reset();
+	InFlightBatch.Reset();
+	InFlightTask = nullptr;
+
+	//Requests that no longer want an answer take no part in the assignment
+	for (int i = 0; i < requests.Num(); i++)
+	{
+		const bool requesterGone = requests[i].Request.Requester != nullptr && !requests[i].Requester.IsValid();
+		if (!requests[i].OnComplete || requesterGone)
+		{
+			batch->Candidates[i].Reset();
+			batch->Scores[i].Reset();
+		}
+	}
+
+	//Assign covers like GetCoversBatch. Covers may have been taken or removed since the snapshot, so each candidate is checked against the live table
+	TArray<int32> assigned;
+	AssignCovers(batch->Candidates, batch->Scores, [this, &batch](int32 id)
+	{
+		return CoverTable.IsValidIndex(id) && CoverTable[id] != nullptr && CoverTable[id] == batch->Covers[id] && !IsCoverIdReserved(id) && !DisabledCovers[id];
+	}, assigned);
+
+	for (int i = 0; i < requests.Num(); i++)
+	{
+		FPendingCoverRequest& pending = requests[i];
+		if (!pending.OnComplete)
+		{
+			continue;
+		}
+		//Nobody to give a cover to, but whoever is waiting on the answer still has to hear back so it can finish
+		if (pending.Request.Requester != nullptr && !pending.Requester.IsValid())
+		{
+			pending.OnComplete(nullptr);
+			continue;
+		}
+
+		AActor* currentCover = pending.CurrentCover.Get();
+		//If there is no valid cover, as in AI's first choice, then fall back to the closest cover
+		AActor* winner = currentCover ? currentCover : GetClosestCover(pending.Request.Position);
+		//An earlier callback may have taken the cover since the assignment was made
+		if (assigned[i] != INDEX_NONE && !IsCoverIdReserved(assigned[i]))
+		{
+			winner = CoverTable[assigned[i]];
+		}
+
+		//Unknown movement types leave the AI where it is without taking the cover, like GetCover
+		if (GetScoringMask(pending.Request.MovementType) != ECoverScoringMask::None)
+		{
+			ReserveCover(winner, pending.Requester.Get());
+		}
+		pending.OnComplete(winner);
+	}
+}
+
+void AAIDirector::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	CoverGrid.Reset(CoverGridCellSize);
+	InfluenceMap.Reset(GetActorLocation(), InfluenceCellSize, InfluenceMapCells, InfluenceHalfLife);
+}
+
+// Called when the game starts or when spawned
+void AAIDirector::BeginPlay()
+{
+	Super::BeginPlay();
+
+	//Path costs follow the navmesh without gameplay code having to call MarkNavCostsDirty. Areas are collected as they are dirtied and their rows rebuilt once the tiles have been
+	NavigationDirtyHandle = UNavigationSystemV1::NavigationDirtyEvent.AddUObject(this, &AAIDirector::OnNavigationDirtied);
+	UNavigationSystemV1* navSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (navSys)
+	{
+		navSys->OnNavigationGenerationFinishedDelegate.AddDynamic(this, &AAIDirector::OnNavigationGenerationFinished);
+	}
+}
+
+void AAIDirector::OnNavigationDirtied(const FBox& bounds)
+{
+	//The event is shared by every world, an area from another one only costs a few extra rows
+	PendingNavDirtyBounds.Add(bounds);
+}
+
+void AAIDirector::OnNavigationGenerationFinished(ANavigationData* navData)
+{
+	if (navData && PendingNavDirtyBounds.Num() == 0)
+	{
+		PendingNavDirtyBounds.Add(navData->GetBounds());
+	}
+}
+
+void AAIDirector::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	UNavigationSystemV1::NavigationDirtyEvent.Remove(NavigationDirtyHandle);
+	UNavigationSystemV1* navSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (navSys)
+	{
+		navSys->OnNavigationGenerationFinishedDelegate.RemoveDynamic(this, &AAIDirector::OnNavigationGenerationFinished);
+	}
+
+	//The worker only holds its own batch, but there is no point finishing requests for a world that is going away
+	if (InFlightTask.IsValid())
+	{
+		FTaskGraphInterface::Get().WaitUntilTaskCompletes(InFlightTask);
+	}
+	InFlightTask = nullptr;
+	InFlightBatch.Reset();
+	InFlightCoverRequests.Reset();
+	QueuedCoverRequests.Reset();
+	Scheduler.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+// Called every frame
+void AAIDirector::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	RefreshThreats();
+	ReleaseExpiredReservations();
+
+	//Blueprints written before the reservation table give covers back by adding them to AllCovers
+	for (AActor* cover : AllCovers)
+	{
+		ReleaseCover(cover);
+	}
+	AllCovers.Reset();
+
+	//Players make the area around them dangerous for as long as they stay there
+	InfluenceMap.AdvanceTime(DeltaTime);
+	for (int i = 0; i < ThreatX.Num(); i++)
+	{
+		InfluenceMap.Stamp(FVector(ThreatX[i], ThreatY[i], ThreatZ[i]), ThreatPresenceRadius, ThreatPresenceDanger * DeltaTime);
+	}
+	InfluenceMap.Decay(InfluenceCellsPerFrame);
+	if (CVarCoverDrawInfluence.GetValueOnGameThread() != 0)
+	{
+		InfluenceMap.DrawDebug(GetWorld(), GetActorLocation().Z, DeathDanger);
+	}
+
+	//A batch dispatched last tick is picked up here, if the worker is still going it is checked again next tick rather than waiting
+	if ((InFlightTask.IsValid() && InFlightTask->IsComplete()) || (!InFlightTask.IsValid() && QueuedCoverRequests.Num() > 0))
+	{
+		Scheduler.Enqueue(MakeWorkKey(EDirectorWork::SquadAssignment), SquadAssignmentPriority, [this]()
+		{
+			if (InFlightTask.IsValid() && InFlightTask->IsComplete())
+			{
+				CompleteCoverRequests();
+			}
+			if (!InFlightTask.IsValid() && QueuedCoverRequests.Num() > 0)
+			{
+				DispatchCoverRequests();
+			}
+		});
+	}
+	//Navigation costs are only a refinement over straight line distance so they come last
+	Scheduler.Enqueue(MakeWorkKey(EDirectorWork::NavCosts), 0.f, [this]() { UpdateNavCosts(); });
+	ScheduleAgentWork();
+
+	{
+		SCOPE_CYCLE_COUNTER(STAT_AIDirectorScheduledWork);
+		const int32 numRun = Scheduler.Run(SchedulerBudget / 1000.0);
+		INC_DWORD_STAT_BY(STAT_AIDirectorItemsRun, numRun);
+		INC_DWORD_STAT_BY(STAT_AIDirectorItemsRolledOver, Scheduler.Num());
+	}
+}
+
+#if WITH_DEV_AUTOMATION_TESTS
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCoverInvalidatedNoRequesterTest, "Gunslingers.Cover.InvalidatedNoRequester", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+//Takes a cover through GetCover without a requester, the way GetCoverAndSetToTarget does, then takes away its only side and checks the agent standing there is the one told
+bool FCoverInvalidatedNoRequesterTest::RunTest(const FString& Parameters)
+{
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& worldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	worldContext.SetCurrentWorld(world);
+
+	//Nothing here begins play, so the director is filled in by hand rather than by the game mode and the actors' BeginPlay
+	AAIDirector* director = world->SpawnActor<AAIDirector>();
+	APawn* threat = world->SpawnActor<ACharacter>(FVector(0.f, 0.f, 0.f), FRotator::ZeroRotator);
+	APawn* agent = world->SpawnActor<ACharacter>(FVector(1000.f, 0.f, 0.f), FRotator::ZeroRotator);
+	//Inside the player's band and within normal cover range of the agent
+	ACoverObject* cover = world->SpawnActor<ACoverObject>(FVector(900.f, 300.f, 0.f), FRotator::ZeroRotator);
+	cover->CoverPoints.AddDefaulted();
+	cover->CoverPoints[0].Location = cover->GetActorLocation();
+
+	director->RegisterThreat(threat);
+	director->RegisterAgent(agent);
+	director->RegisterCover(cover);
+
+	AActor* taken = director->GetCover(agent->GetActorLocation(), agent->GetActorForwardVector(), nullptr, MovementTypes::Normal);
+	TestEqual(TEXT("GetCover returns the only cover"), taken, (AActor*)cover);
+	TestEqual(TEXT("The cover is reserved for the agent at the query position"), director->GetCoverOwner(cover), (AActor*)agent);
+
+	cover->CoverPoints[0].Enabled = false;
+	director->UpdateCoverPoint(cover, 0);
+	TestEqual(TEXT("The agent is told its cover was invalidated"), director->GetInvalidatedCover(agent), (AActor*)cover);
+	TestFalse(TEXT("The cover is given back"), director->IsCoverReserved(cover));
+
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+	return true;
+}
+
+//The cover of one movement type the original director would have picked, scoring every cover with the FVector maths and no grid. nullptr if none is valid
+static AActor* SelectCoverReference(const FCoverScoringInput& input, const TArray<AActor*>& covers, MovementTypes movementType)
+{
+	uint8 typeMask = ECoverScoringMask::None;
+	switch (movementType)
+	{
+	case MovementTypes::Normal:
+		typeMask = ECoverScoringMask::Normal;
+		break;
+	case MovementTypes::Flanking:
+		typeMask = ECoverScoringMask::Flanking;
+		break;
+	case MovementTypes::Advancing:
+		typeMask = ECoverScoringMask::Advancing;
+		break;
+	case MovementTypes::Retreating:
+		typeMask = ECoverScoringMask::Retreating;
+		break;
+	}
+	const bool preferFurthest = movementType == MovementTypes::Flanking;
+
+	AActor* best = nullptr;
+	float bestDistance = preferFurthest ? -MAX_flt : MAX_flt;
+	for (AActor* cover : covers)
+	{
+		const FVector coverLoc = cover->GetActorLocation();
+		if ((CoverScoring::ScoreCoverReference(input, coverLoc) & typeMask) == 0)
+		{
+			continue;
+		}
+		const float distance = (input.AILocation - coverLoc).Size();
+		if (preferFurthest ? distance > bestDistance : distance < bestDistance)
+		{
+			bestDistance = distance;
+			best = cover;
+		}
+	}
+	return best;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCoverSelectionMatchesReferenceTest, "Gunslingers.Cover.SelectionMatchesReference", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+//Runs GetCoverOptions, GetCover and GetCoversBatch over randomized layouts with both kernels and fails on any cover that is not the one the original scoring picks
+bool FCoverSelectionMatchesReferenceTest::RunTest(const FString& Parameters)
+{
+	const int32 numLayouts = 20;
+	const int32 numCovers = 80;
+	const MovementTypes movementTypes[] = { MovementTypes::Normal, MovementTypes::Flanking, MovementTypes::Advancing, MovementTypes::Retreating };
+	IConsoleVariable* scalarScoring = IConsoleManager::Get().FindConsoleVariable(TEXT("ai.Cover.ScalarScoring"));
+	const int32 previousScalarScoring = scalarScoring ? scalarScoring->GetInt() : 0;
+
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& worldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	worldContext.SetCurrentWorld(world);
+	FActorSpawnParameters spawnParams;
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	//Ranking by distance only, so the original scoring is a fair reference
+	AAIDirector* director = world->SpawnActor<AAIDirector>(spawnParams);
+	director->DangerCost = 0.f;
+	director->ExposureCost = 0.f;
+	director->ThreatSelection = ThreatSelectionTypes::NearestThreat;
+
+	int32 mismatches = 0;
+	for (int32 scalar = 0; scalar < 2; scalar++)
+	{
+		if (scalarScoring)
+		{
+			scalarScoring->Set(scalar, ECVF_SetByCode);
+		}
+		FRandomStream random(4321);
+		for (int layout = 0; layout < numLayouts; layout++)
+		{
+			//The player and up to two co-op players, facing anywhere
+			const FVector playerLocation(random.FRandRange(-5000.f, 5000.f), random.FRandRange(-5000.f, 5000.f), random.FRandRange(0.f, 500.f));
+			TArray<APawn*> threats;
+			const int32 numThreats = random.RandRange(1, 3);
+			for (int t = 0; t < numThreats; t++)
+			{
+				const FVector offset = t == 0 ? FVector::ZeroVector : FVector(random.FRandRange(-1500.f, 1500.f), random.FRandRange(-1500.f, 1500.f), 0.f);
+				threats.Add(world->SpawnActor<ACharacter>(playerLocation + offset, FRotator(0.f, random.FRandRange(-180.f, 180.f), 0.f), spawnParams));
+				director->RegisterThreat(threats.Last());
+			}
+
+			TArray<AActor*> covers;
+			for (int i = 0; i < numCovers; i++)
+			{
+				const FVector location = playerLocation + FVector(random.FRandRange(-2000.f, 2000.f), random.FRandRange(-2000.f, 2000.f), random.FRandRange(-100.f, 100.f));
+				ACoverObject* cover = world->SpawnActor<ACoverObject>(location, FRotator::ZeroRotator, spawnParams);
+				cover->CoverPoints.AddDefaulted();
+				cover->CoverPoints[0].Location = location;
+				director->RegisterCover(cover);
+				covers.Add(cover);
+			}
+
+			const FVector aiLocation = playerLocation + FVector(random.FRandRange(-2000.f, 2000.f), random.FRandRange(-2000.f, 2000.f), 0.f);
+			const FVector aiForward = random.GetUnitVector().GetSafeNormal2D();
+
+			//The same input the director builds, from the threat nearest the AI
+			FCoverScoringInput input;
+			input.AILocation = aiLocation;
+			input.AIForward = aiForward;
+			input.MinDistanceFromPlayer = director->MinDistanceAwayFromPlayer;
+			input.MaxDistanceFromPlayer = director->MaxDistanceAwayFromPlayer;
+			APawn* player = director->GetNearestThreat(aiLocation);
+			input.PlayerLocation = player->GetActorLocation();
+			input.PlayerForward = player->GetActorForwardVector();
+			for (APawn* threat : threats)
+			{
+				if (threat != player)
+				{
+					input.OtherThreatX.Add(threat->GetActorLocation().X);
+					input.OtherThreatY.Add(threat->GetActorLocation().Y);
+					input.OtherThreatZ.Add(threat->GetActorLocation().Z);
+				}
+			}
+
+			//GetCover and GetCoversBatch stay in the closest cover when none of the type is valid
+			AActor* closest = nullptr;
+			for (AActor* cover : covers)
+			{
+				if (closest == nullptr || (cover->GetActorLocation() - aiLocation).Size() < (closest->GetActorLocation() - aiLocation).Size())
+				{
+					closest = cover;
+				}
+			}
+
+			//Covers the same distance from the AI to within rounding may be picked either way
+			auto check = [&](const TCHAR* query, MovementTypes movementType, AActor* picked, AActor* expected)
+			{
+				if (picked == expected || (picked && expected && FMath::IsNearlyEqual((picked->GetActorLocation() - aiLocation).Size(), (expected->GetActorLocation() - aiLocation).Size(), 0.01f)))
+				{
+					return;
+				}
+				AddError(FString::Printf(TEXT("Kernel %s layout %d %s type %d: picked %s, original scoring picked %s"), scalar ? TEXT("scalar") : TEXT("SIMD"), layout, query, (int32)movementType, *GetNameSafe(picked), *GetNameSafe(expected)));
+				mismatches++;
+			};
+
+			const FCoverOptions options = director->GetCoverOptions(aiLocation, aiForward, nullptr);
+			for (MovementTypes movementType : movementTypes)
+			{
+				AActor* expected = SelectCoverReference(input, covers, movementType);
+				check(TEXT("GetCoverOptions"), movementType, AAIDirector::SelectCoverOption(options, movementType), expected);
+
+				//Each answer is given back so the next query sees every cover again
+				AActor* taken = director->GetCover(aiLocation, aiForward, nullptr, movementType);
+				check(TEXT("GetCover"), movementType, taken, expected ? expected : closest);
+				director->ReleaseCover(taken);
+
+				FCoverRequest request;
+				request.Position = aiLocation;
+				request.Forward = aiForward;
+				request.MovementType = movementType;
+				const TArray<AActor*> batched = director->GetCoversBatch({ request });
+				check(TEXT("GetCoversBatch"), movementType, batched[0], expected ? expected : closest);
+				director->ReleaseCover(batched[0]);
+			}
+
+			for (AActor* cover : covers)
+			{
+				director->UnregisterCover(cover);
+				cover->Destroy();
+			}
+			for (APawn* threat : threats)
+			{
+				director->UnregisterThreat(threat);
+				threat->Destroy();
+			}
+		}
+	}
+
+	if (scalarScoring)
+	{
+		scalarScoring->Set(previousScalarScoring, ECVF_SetByCode);
+	}
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+
+	TestEqual(TEXT("Covers picked differently from the original scoring"), mismatches, 0);
+	return true;
+}
+#endif
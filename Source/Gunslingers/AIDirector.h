@@ -4,8 +4,22 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "CoverSpatialGrid.h"
+#include "CoverScoring.h"
+#include "CoverNavCostTable.h"
+#include "CoverAssignment.h"
+#include "CoverInfluenceMap.h"
+#include "AIWorkScheduler.h"
+#include "CoverPointBVH.h"
+#include "CoverObject.h"
+#include "AI/Navigation/NavigationTypes.h"
 #include "AIDirector.generated.h"
 
+struct FCoverAsyncBatch;
+
+//Sent when the director finds the cover an AI has reserved is no longer any good, e.g. a player has moved so they can see into it
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnCoverInvalidated, AActor*, Agent, AActor*, Cover);
+
 UENUM(BlueprintType)
 enum MovementTypes
 {
@@ -15,6 +29,56 @@ enum MovementTypes
 	Retreating UMETA(DisplayName = "Retreating")
 };
 
+//Which player an AI takes cover from when there is more than one
+UENUM(BlueprintType)
+enum ThreatSelectionTypes
+{
+	NearestThreat UMETA(DisplayName = "Nearest"),
+	MostDangerousThreat UMETA(DisplayName = "Most Dangerous")
+};
+
+//The best cover of every movement type for one AI, found in a single pass over the covers
+USTRUCT(BlueprintType)
+struct FCoverOptions
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "AI")
+	AActor* Normal = nullptr;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "AI")
+	AActor* Flanking = nullptr;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "AI")
+	AActor* Advancing = nullptr;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "AI")
+	AActor* Retreating = nullptr;
+};
+
+//One AI's request for cover in a batched query
+USTRUCT(BlueprintType)
+struct FCoverRequest
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
+	FVector Position = FVector::ZeroVector;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
+	FVector Forward = FVector::ForwardVector;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
+	AActor* CurrentCover = nullptr;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
+	TEnumAsByte<MovementTypes> MovementType = MovementTypes::Normal;
+
+	//The AI asking, becomes the owner of the cover it is given
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
+	AActor* Requester = nullptr;
+};
+
 UCLASS()
 class GUNSLINGERS_API AAIDirector : public AActor
 {
@@ -25,10 +89,14 @@ public:
 	AAIDirector();	
 
 
-	//Stores a reference to each of the cover objects around the cover mesh
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "AI")
+	//Covers given back by adding them here, the way Blueprints returned covers before the reservation table. Each one is released on the next tick and the array emptied, it is not the list of covers
+	UPROPERTY(BlueprintReadWrite, Category = "AI", meta = (DeprecatedProperty, DeprecationMessage = "Call ReleaseCover or ReleaseCoversOwnedBy instead"))
 	TArray<AActor*> AllCovers;
 
+	//Every registered cover by id, null in the slots of covers that have been unregistered
+	UFUNCTION(BlueprintPure, Category = "AI")
+	TArray<AActor*> GetAllCovers() const { return CoverTable; }
+
 	//Stores a reference to each of the cover objects around the cover mesh
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
 	float MinDistanceAwayFromPlayer = 400.f;
@@ -37,21 +105,233 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
 	float MaxDistanceAwayFromPlayer = 1500.f;
 
+	//Size of each cell of the grid used to look up covers by position, should be around the size of MinDistanceAwayFromPlayer
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float CoverGridCellSize = 500.f;
+
+	//Size of the cells the player's position is snapped to for the candidate cache. Queries made while the player stays in one cell reuse the covers found for it instead of walking the grid
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float CandidateCacheCellSize = 200.f;
+
+	//Covers further apart than this have no path cost stored, queries fall back to straight line distance for them
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float NavCostRadius = 3000.f;
+
+	//Most path queries the cost table keeps waiting on the navigation system at once, a row is only started while below this
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	int32 MaxNavCostQueriesInFlight = 64;
+
+	//How many ranked candidates each request in a batch keeps, so that if its best cover is claimed by an earlier request it can fall back to the next best
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	int32 BatchCandidatesPerRequest = 4;
+
+	//Most time in milliseconds the squad assignment of one batch can take before the batch falls back to handing out covers in request order
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float SquadAssignmentTimeBudget = 0.5f;
+
+	//Smallest amount the squad assignment raises a cover's price by. The total distance travelled is within this much per AI of the best possible, larger values finish faster
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float SquadAssignmentEpsilon = 10.f;
+
+	//How much further than its best cover an AI will go before the squad assignment would rather leave it where it is
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float SquadStayPutCost = 2000.f;
+
+	//How long in seconds an AI keeps a cover after being given it, asking for cover again renews it. Zero means reservations never expire
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float CoverLeaseDuration = 60.f;
+
+	//Size of each cell of the danger map
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float InfluenceCellSize = 200.f;
+
+	//Number of cells along each side of the danger map, it is centred on the director. Danger outside it is ignored
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	int32 InfluenceMapCells = 128;
+
+	//Seconds it takes danger to halve
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float InfluenceHalfLife = 4.f;
+
+	//Most danger map cells decayed each frame, the rest catch up on later frames
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	int32 InfluenceCellsPerFrame = 4096;
+
+	//How much further the AI will travel per unit of danger avoided when ranking covers, zero ignores danger
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float DangerCost = 300.f;
+
+	//How much further the AI will travel to avoid a cover that is fully open towards the player, scaled by how open it is. Zero ignores exposure
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float ExposureCost = 500.f;
+
+	//Danger added where a player's shot lands, and how far it spreads
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float ShotDanger = 1.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float ShotDangerRadius = 300.f;
+
+	//Danger added where an enemy dies, and how far it spreads
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float DeathDanger = 5.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float DeathDangerRadius = 600.f;
+
+	//Danger added around each player per second, and how far it spreads
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float ThreatPresenceDanger = 1.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float ThreatPresenceRadius = 500.f;
+
+	//Most time in milliseconds the director spends on scheduled work each frame, whatever does not fit waits for the next frame
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float SchedulerBudget = 1.f;
+
+	//Seconds between each AI's line of sight and cover checks
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float AgentRefreshInterval = 0.5f;
+
+	//Every enemy the director does background work for, enemies add themselves on BeginPlay
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "AI")
+	TArray<class APawn*> Agents;
+
+	//Called when an AI's cover check finds its reserved cover is no longer valid for it, so its behaviour can look for another
+	UPROPERTY(BlueprintAssignable, Category = "AI")
+	FOnCoverInvalidated OnCoverInvalidated;
+
+	//Every player the AI take cover from, players add themselves on BeginPlay
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "AI")
+	TArray<class APawn*> Threats;
+
+	//Which threat flanking, advancing and retreating are worked out relative to
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	TEnumAsByte<ThreatSelectionTypes> ThreatSelection = ThreatSelectionTypes::NearestThreat;
+
+	//How far ahead in seconds threat movement is predicted when picking the most dangerous one
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	float ThreatPredictionTime = 0.5f;
+
+	//Reject covers where every side can be seen from the cover a player is in, needs an ACoverLevelData with a baked visibility matrix in the level
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "AI")
+	bool RejectExposedCovers = true;
+
+	//Baked data for the current level, it hooks itself up on BeginPlay
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "AI")
+	class ACoverLevelData* CoverLevelData = nullptr;
+
 	UFUNCTION(BlueprintCallable)
 	float GetDistanceFromAIToPlayer(FVector pos);
 
 
 
-	UFUNCTION()
-	void FindAllCovers();
+	//Returns the director of the world the object is in, or nullptr if the game mode does not have one
+	static AAIDirector* Get(const UObject* worldContextObject);
+
+	//REGISTRATION
+
+	//Adds a cover to the director, covers call this themselves on BeginPlay so streamed in sublevels are picked up. Returns the cover's id
+	UFUNCTION(BlueprintCallable)
+	int32 RegisterCover(AActor* cover);
+
+	//Removes a cover from the director, covers call this themselves on EndPlay
+	UFUNCTION(BlueprintCallable)
+	void UnregisterCover(AActor* cover);
+
+	//Sets the baked level data used to check visibility between covers, nullptr turns the checks off
+	void SetCoverLevelData(class ACoverLevelData* levelData);
+
+	//LIFECYCLE
+
+	//Called by a cover after it has moved. Moves its grid entry and cover point boxes, drops its baked visibility and tells the AI holding it, without rebuilding anything for the other covers
+	UFUNCTION(BlueprintCallable)
+	void UpdateCoverLocation(AActor* cover, FVector previousLocation);
+
+	//Called by a cover object after one of its cover points has been enabled or disabled. A cover with every point disabled is skipped by all queries and the AI holding it loses it
+	UFUNCTION(BlueprintCallable)
+	void UpdateCoverPoint(AActor* cover, int32 pointIndex);
+
+	//Called by a cover object once it has traced the exposure of points that came without it
+	void UpdateCoverExposure(AActor* cover);
+
+	//Whether any enabled side of the cover is high cover, which cannot be shot over standing up
+	UFUNCTION(BlueprintPure)
+	bool IsHighCover(AActor* cover) const;
+
+	//NAVIGATION COSTS
+
+	//Path cost between two covers if the table has it, otherwise the straight line distance from pos to toCover
+	UFUNCTION(BlueprintCallable)
+	float GetTravelCost(AActor* fromCover, AActor* toCover, FVector pos);
+
+	//Rebuilds the path costs of every cover near bounds once the navmesh has finished updating, call after changing anything that affects navigation there
+	UFUNCTION(BlueprintCallable)
+	void MarkNavCostsDirty(FBox bounds);
+
+	//DANGER
+
+	//Adds danger at location, falling off to nothing at radius
+	UFUNCTION(BlueprintCallable)
+	void AddDanger(FVector location, float radius, float amount);
+
+	//Called by player weapons with where each shot landed
+	UFUNCTION(BlueprintCallable)
+	void ReportShot(FVector impactLocation);
+
+	//Called by enemies when they are killed
+	UFUNCTION(BlueprintCallable)
+	void ReportDeath(FVector location);
+
+	UFUNCTION(BlueprintPure)
+	float GetDanger(FVector location) const;
+
+	//AGENTS
+
+	//Adds an enemy whose line of sight and cover the director checks in the background
+	UFUNCTION(BlueprintCallable)
+	void RegisterAgent(APawn* agent);
+
+	UFUNCTION(BlueprintCallable)
+	void UnregisterAgent(APawn* agent);
+
+	//Whether the agent could see the player it is reacting to at its last line of sight check
+	UFUNCTION(BlueprintPure)
+	bool CanAgentSeeThreat(APawn* agent) const;
+
+	//The cover last reported to the agent through OnCoverInvalidated, null while the cover it holds is still valid
+	UFUNCTION(BlueprintPure)
+	AActor* GetInvalidatedCover(APawn* agent) const;
+
+	//THREATS
+
+	//Adds a player for the AI to take cover from
+	UFUNCTION(BlueprintCallable)
+	void RegisterThreat(APawn* threat);
+
+	UFUNCTION(BlueprintCallable)
+	void UnregisterThreat(APawn* threat);
+
+	//Returns the threat an AI at pos looking along forward should react to, depending on ThreatSelection. nullptr if there are none
+	UFUNCTION(BlueprintCallable)
+	APawn* SelectThreat(FVector pos, FVector forward);
+
+	UFUNCTION(BlueprintCallable)
+	APawn* GetNearestThreat(FVector pos);
 
 	UFUNCTION(BlueprintCallable)
 	AActor* GetClosestCover(FVector pos);
 
+	//Intersects a ray with the box of every cover point around the registered cover objects, without touching the physics scene. Fills outCovers with every cover point hit, nearest along the ray first, and returns the first one or an invalid ref
+	UFUNCTION(BlueprintCallable)
+	FCoverPointRef RaycastCoverPoints(FVector origin, FVector direction, float length, TArray<FCoverPointRef>& outCovers);
+
 	//FIND ALLS
 
+	//pos and forward are the querying AI's, they pick which player is flanked when there is more than one
 	UFUNCTION(BlueprintCallable)
-	TArray<AActor*> FindAllFlankingCovers();
+	TArray<AActor*> FindAllFlankingCovers(FVector pos, FVector forward);
 
 	UFUNCTION(BlueprintCallable)
 	TArray<AActor*> FindAllNormalCovers(FVector pos);
@@ -77,15 +357,308 @@ public:
 	AActor* GetAdvancingCover(FVector pos, FVector forward, AActor* coverAIIsIn);
 
 
+	//Finds the best normal, flanking, advancing and retreating cover together in one pass with no temporary arrays. Any type with no valid cover is set to coverAIIsIn so the AI stays put
+	UFUNCTION(BlueprintCallable)
+	FCoverOptions GetCoverOptions(FVector pos, FVector forward, AActor* coverAIIsIn);
+
+	//Picks the cover of the wanted movement type out of a GetCoverOptions result
+	UFUNCTION(BlueprintPure)
+	static AActor* SelectCoverOption(const FCoverOptions& options, MovementTypes movementType);
+
+	//Resolves many AI's cover requests in one call. Scoring runs in parallel, then covers are assigned to the whole squad together so no two AI are given the same cover and the total distance travelled is kept low. Returns one cover per request, with the same semantics as GetCover
+	UFUNCTION(BlueprintCallable)
+	TArray<AActor*> GetCoversBatch(const TArray<FCoverRequest>& requests);
+
+	//ASYNC
+
+	//Queues a cover request that is scored on a worker thread against a snapshot of the covers, so it never stalls the game thread. onComplete is called on the game thread on a later tick with the same result GetCover would give, or nullptr if the requester has been destroyed since. Returns an id that can be used to cancel it
+	int32 RequestCoverAsync(const FCoverRequest& request, TFunction<void(AActor*)> onComplete);
+
+	//Stops a queued request, its onComplete will not be called
+	void CancelCoverRequest(int32 requestId);
+
 	//This last function will be the only outside called function and will take an enum type {retreating, advancing, flanking, normal}
 
+	//The cover is reserved for requester. Blueprints that leave it unset reserve it for the registered agent standing at pos, so its cover is still checked and given back when it dies
+	UFUNCTION(BlueprintCallable)
+	AActor* GetCover(FVector pos, FVector forward, AActor* coverAIIsIn, MovementTypes movementType, AActor* requester = nullptr);
+
+	//RESERVATIONS
+
+	//Marks a cover as taken by owner so no other AI is given it, returns false if it is already taken
+	UFUNCTION(BlueprintCallable)
+	bool ReserveCover(AActor* cover, AActor* owner);
+
+	//Gives a cover back so other AI can be given it
 	UFUNCTION(BlueprintCallable)
-	AActor* GetCover(FVector pos, FVector forward, AActor* coverAIIsIn, MovementTypes movementType);
+	void ReleaseCover(AActor* cover);
+
+	//Gives back every cover owned by owner, called automatically when an enemy is removed from the world
+	UFUNCTION(BlueprintCallable)
+	void ReleaseCoversOwnedBy(AActor* owner);
+
+	UFUNCTION(BlueprintPure)
+	bool IsCoverReserved(AActor* cover) const;
+
+	//The AI the cover is reserved for, null if it is free
+	UFUNCTION(BlueprintPure)
+	AActor* GetCoverOwner(AActor* cover) const;
 
 protected:
+	//Spatial index over every cover in CoverTable by id
+	FCoverSpatialGrid CoverGrid;
+
+	//Boxes of the cover points around every cover object, payloads index CoverPointRefs. Rebuilt on the next raycast after covers register, boxes of covers that move, change or unregister are updated in place
+	FCoverPointBVH CoverPointBVH;
+	TArray<FCoverPointRef> CoverPointRefs;
+	bool CoverPointBVHDirty = true;
+	void BuildCoverPointBVH();
+
+	//First box of each cover by id, INDEX_NONE if it has none in the tree
+	TArray<int32> CoverBVHFirstBoxes;
+
+	//First box of a cover object's points if the tree is up to date with them, otherwise INDEX_NONE
+	int32 GetCoverPointFirstBox(int32 id, const ACoverObject* coverObject) const;
+
+	//Read only copy of CoverGrid shared with async queries, only copied again after covers register or unregister, or enough of them have moved
+	TSharedPtr<const FCoverSpatialGrid, ESPMode::ThreadSafe> CoverGridSnapshot;
+
+	//Covers by id that have moved since the snapshot was copied
+	TBitArray<> CoverMovedSinceSnapshot;
+	int32 NumCoversMovedSinceSnapshot = 0;
+
+	//Threat positions, velocities and facing as structure-of-arrays in the same order as Threats, refreshed once per frame so queries never touch the pawns
+	TArray<float> ThreatX;
+	TArray<float> ThreatY;
+	TArray<float> ThreatZ;
+	TArray<float> ThreatVelocityX;
+	TArray<float> ThreatVelocityY;
+	TArray<float> ThreatVelocityZ;
+	TArray<float> ThreatForwardX;
+	TArray<float> ThreatForwardY;
+	TArray<float> ThreatForwardZ;
+	//Baked cover point each threat is in, INDEX_NONE if it is not in one
+	TArray<int32> ThreatCoverPoints;
+	bool AnyThreatInBakedCover = false;
+	uint64 ThreatsRefreshedFrame = MAX_uint64;
+
+	//Copies the threats into the arrays above, does nothing if it has already run this frame
+	void RefreshThreats();
+
+	int32 SelectThreatIndex(const FVector& pos, const FVector& forward) const;
+	int32 GetNearestThreatIndex(const FVector& pos) const;
+
+	//Runs squad assignment, navigation cost updates and every agent's checks within SchedulerBudget
+	FAIWorkScheduler Scheduler;
+
+	//Per agent state in the same order as Agents
+	TBitArray<> AgentCanSeeThreat;
+	TArray<float> AgentNextRefreshTimes;
+	//Cover last reported through OnCoverInvalidated for each agent, so it is only reported once
+	TArray<TWeakObjectPtr<AActor>> AgentInvalidatedCovers;
+
+	//Queues the checks of every agent that is due one
+	void ScheduleAgentWork();
+
+	//Agents close to or able to see a player are worked on first
+	float GetAgentPriority(int32 agentIndex) const;
+
+	void RefreshAgentLineOfSight(APawn* agent);
+
+	//Checks the cover the agent has reserved is still valid against the threats and calls OnCoverInvalidated if not
+	void ReevaluateAgentCover(APawn* agent);
+
+	//The registered agent closest to pos if it is within AgentMatchDistance, for queries that were not told who is asking
+	APawn* FindAgentAt(const FVector& pos) const;
+
+	//Recent danger across the level, weighed against distance when ranking covers
+	FCoverInfluenceMap InfluenceMap;
+
+	//Path cost from each cover to the covers within NavCostRadius of it
+	FCoverNavCostTable NavCosts;
+
+	//A row of the cost table waiting on its path queries
+	struct FNavCostRowBuild
+	{
+		int32 Generation = 0;
+		int32 Remaining = 0;
+		TArray<int32> Ids;
+		TArray<float> Costs;
+	};
+	TMap<int32, FNavCostRowBuild> NavCostRowBuilds;
+
+	//Which row and slot each async path query fills in
+	struct FNavCostQuery
+	{
+		int32 RowId;
+		int32 Generation;
+		int32 Slot;
+	};
+	TMap<uint32, FNavCostQuery> NavCostQueries;
+
+	//Areas changed since the navmesh last finished building, their rows are marked dirty once it has. Filled from the navigation system's dirty areas as well as by hand
+	TArray<FBox> PendingNavDirtyBounds;
+
+	FDelegateHandle NavigationDirtyHandle;
+	void OnNavigationDirtied(const FBox& bounds);
+
+	//A build that finishes with no dirty areas was a full one, so every row it covers is rebuilt
+	UFUNCTION()
+	void OnNavigationGenerationFinished(class ANavigationData* navData);
+
+	//Starts rebuilding dirty rows while there is room for more path queries
+	void UpdateNavCosts();
+
+	//Queues a path query from the cover to every cover within NavCostRadius
+	void StartNavCostRow(int32 id, class UNavigationSystemV1& navSys, class ANavigationData& navData);
+
+	void OnNavCostPathFound(uint32 queryId, ENavigationQueryResult::Type result, FNavPathSharedPtr path);
+
+	//Marks the rows of every cover within NavCostRadius of bounds dirty
+	void MarkNavCostRowsNear(const FBox& bounds);
+
+	//A point on the navmesh for a cover, the side of it closest to towards
+	FVector GetNavLocation(int32 id, const FVector& towards) const;
+
+	//Every cover that could be in the distance band for any player position in one cell. The kernel still runs on each of them per query, so results are exact, but the grid walk and cell culling only happen when the player changes cell
+	struct FCoverCandidateCache
+	{
+		FIntVector PlayerCell = FIntVector::ZeroValue;
+		float CellSize = 0.f;
+		float MinDistance = 0.f;
+		float MaxDistance = 0.f;
+		//Read only once built so it can be shared with async queries
+		TSharedPtr<const FCoverGridCell, ESPMode::ThreadSafe> Candidates;
+	};
+	//One cache per threat, in the same order as Threats
+	TArray<FCoverCandidateCache> CandidateCaches;
+
+	//Rebuilds a candidate cache if its threat has moved into another cell or the covers have changed
+	void UpdateCandidateCache(FCoverCandidateCache& cache, const FVector& playerLocation);
+
+	//Throws away the candidate caches whose band holds location, they are rebuilt from the grid around their threat on the next query
+	void InvalidateCandidateCachesNear(const FVector& location);
+
+	//Returns the cached candidates built for the cell the input's threat is in, otherwise nullptr
+	TSharedPtr<const FCoverGridCell, ESPMode::ThreadSafe> GetCachedCandidates(const FCoverScoringInput& input) const;
+
+	//One async cover request waiting for its result
+	struct FPendingCoverRequest
+	{
+		int32 RequestId;
+		FCoverRequest Request;
+		//The request is dropped if its requester is destroyed before it completes
+		TWeakObjectPtr<AActor> Requester;
+		TWeakObjectPtr<AActor> CurrentCover;
+		TFunction<void(AActor*)> OnComplete;
+	};
+
+	//Requests waiting for the next dispatch
+	TArray<FPendingCoverRequest> QueuedCoverRequests;
+	//Requests being scored by the worker, in the same order as the batch
+	TArray<FPendingCoverRequest> InFlightCoverRequests;
+	TSharedPtr<FCoverAsyncBatch, ESPMode::ThreadSafe> InFlightBatch;
+	FGraphEventRef InFlightTask;
+	int32 NextCoverRequestId = 0;
+
+	//Sends every queued request to a worker in one batch
+	void DispatchCoverRequests();
+
+	//Hands out the covers of a finished batch and calls back each requester
+	void CompleteCoverRequests();
+
+	//Id of each cover in CoverTable
+	TMap<AActor*, int32> CoverIds;
+
+	//Ids of unregistered covers that can be given to the next cover that registers
+	TArray<int32> FreeCoverIds;
+
+	//Index of each cover in CoverLevelData by id, INDEX_NONE if it was not baked
+	TArray<int32> CoverBakedIndices;
+
+	//Reservation table, indexed by cover id. A set bit means the cover is taken and queries skip it
+	TBitArray<> ReservedCovers;
+	TArray<TWeakObjectPtr<AActor>> CoverOwners;
+	//World time each reservation expires, zero for never
+	TArray<float> CoverLeaseExpiryTimes;
+
+	//Covers by id with every cover point disabled, kept in the grid but skipped by queries
+	TBitArray<> DisabledCovers;
+
+	//Covers by id with an enabled high cover point
+	TBitArray<> HighCovers;
+
+	//FCoverPoint::NumExposureSectors bytes per cover by id, the least exposed enabled point of the cover in each world direction. Read by scoring with one lookup per cover
+	TArray<uint8> CoverExposure;
+
+	//Read only copy of CoverExposure shared with async queries, copied again only after it has changed
+	TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> CoverExposureSnapshot;
+
+	//Works out a cover's row of CoverExposure and its HighCovers bit from its enabled cover points
+	void UpdateCoverExposure(int32 id);
+
+	int32 GetCoverId(AActor* cover) const;
+	bool IsCoverIdReserved(int32 id) const { return ReservedCovers[id]; }
+	bool IsCoverIdAvailable(int32 id) const { return !ReservedCovers[id] && !DisabledCovers[id] && !IsCoverIdExposed(id); }
+	bool ReserveCoverId(int32 id, AActor* owner);
+	void ReleaseCoverId(int32 id);
+
+	//True if every side of the cover can be seen from the cover point any threat is in
+	bool IsCoverIdExposed(int32 id) const;
+
+	//Frees reservations whose owner has been destroyed or whose lease has run out
+	void ReleaseExpiredReservations();
+
+	//Tells the AI holding a cover that it has changed through OnCoverInvalidated, and gives the cover back if release is set
+	void NotifyCoverHolder(int32 id, bool release);
+
+	//Builds the scoring kernel input for an AI at pos looking along forward against the threat it should react to and every other threat
+	FCoverScoringInput MakeScoringInput(FVector pos, FVector forward);
+
+	//Runs the scoring kernel over the cached candidates, or the grid cells around the player if there are none, and calls visitor with each cover that isAvailable accepts and is valid for at least one movement type, its ECoverScoringMask bits, its distance to the AI
+	//and the distance its danger and exposure to the player are worth (zero if the input has neither)
+	static void ScoreCoversInBand(const FCoverSpatialGrid& grid, const FCoverGridCell* cachedCandidates, const FCoverScoringInput& input, TFunctionRef<bool(int32)> isAvailable, TFunctionRef<void(int32, uint8, float, float)> visitor);
+
+	//Runs the scoring kernel over every cover in one cell
+	static void ScoreCoverCell(const FCoverGridCell& cell, const FCoverScoringInput& input, TFunctionRef<bool(int32)> isAvailable, TFunctionRef<void(int32, uint8, float, float)> visitor);
+
+	//ScoreCoversInBand over the live covers, skipping ones that are reserved or exposed to the player
+	void ScoreCoversInBand(const FCoverScoringInput& input, TFunctionRef<void(int32, uint8, float, float)> visitor) const;
+
+	//Fills outCoverIds with up to maxCandidates covers of the wanted type, best first, and outScores with the score of each (lower is better). Covers are ranked by path cost from travelCosts' cover where it is known and straight line distance otherwise.
+	//Only reads what it is given so it is safe to call from worker threads
+	static void FindRankedCovers(const FCoverSpatialGrid& grid, const FCoverGridCell* cachedCandidates, const FCoverNavCostRow* travelCosts, const FCoverScoringInput& input, TFunctionRef<bool(int32)> isAvailable, MovementTypes movementType, int32 maxCandidates, TArray<int32>& outCoverIds, TArray<float>& outScores);
+
+	//FindRankedCovers over the live covers
+	void FindRankedCovers(const FCoverScoringInput& input, const FCoverNavCostRow* travelCosts, MovementTypes movementType, int32 maxCandidates, TArray<int32>& outCoverIds, TArray<float>& outScores) const;
+
+	//Picks one cover per request out of each request's ranked candidates so no two share a cover, skipping candidates isAvailable rejects. Solved as an assignment over the whole batch within SquadAssignmentTimeBudget, otherwise greedily in request order.
+	//Writes INDEX_NONE for requests that get none of their candidates
+	void AssignCovers(const TArray<TArray<int32>>& candidates, const TArray<TArray<float>>& scores, TFunctionRef<bool(int32)> isAvailable, TArray<int32>& outCoverIds);
+	//Kept between batches so its arrays are not reallocated every time
+	FCoverAssignmentProblem AssignmentProblem;
+
+	//The ECoverScoringMask bit that matches a movement type
+	static uint8 GetScoringMask(MovementTypes movementType);
+
+	//Returns every cover that has any of the typeMask bits set
+	TArray<AActor*> CollectCovers(const FCoverScoringInput& input, uint8 typeMask) const;
+
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	// Sets up the grid before any cover can register
+	virtual void PostInitializeComponents() override;
+
+	// Waits for any async query still running so it does not outlive the world
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	//Stores a reference to each registered cover object. The index of a cover in this array is its id and never changes while it is registered, taken covers are tracked by the reservation table instead of being removed.
+	//Slots of covers that have been unregistered (e.g. their sublevel streamed out) are null until reused. Every per cover array is the same length, so only RegisterCover may grow it
+	UPROPERTY()
+	TArray<AActor*> CoverTable;
+
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
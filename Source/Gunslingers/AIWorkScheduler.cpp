@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "AIWorkScheduler.h"
+#include "HAL/PlatformTime.h"
+
+void FAIWorkScheduler::Enqueue(uint64 key, float priority, TFunction<void()> work)
+{
+	if (key != 0 && QueuedKeys.Contains(key))
+	{
+		for (FWorkItem& item : Items)
+		{
+			if (item.Key == key)
+			{
+				item.Priority = FMath::Max(item.Priority, priority);
+				return;
+			}
+		}
+	}
+
+	FWorkItem item;
+	item.Key = key;
+	item.Priority = priority;
+	item.QueuedTime = FPlatformTime::Seconds();
+	item.Work = MoveTemp(work);
+	Items.Add(MoveTemp(item));
+	if (key != 0)
+	{
+		QueuedKeys.Add(key);
+	}
+}
+
+int32 FAIWorkScheduler::Run(double budgetSeconds)
+{
+	if (Items.Num() == 0)
+	{
+		return 0;
+	}
+
+	const double start = FPlatformTime::Seconds();
+	const double deadline = start + budgetSeconds;
+
+	//Sort by priority plus age, equal scores keep the order they were queued in
+	const float ageWeight = AgePriorityPerSecond;
+	Items.StableSort([start, ageWeight](const FWorkItem& a, const FWorkItem& b)
+	{
+		return a.Priority + ageWeight * (float)(start - a.QueuedTime) > b.Priority + ageWeight * (float)(start - b.QueuedTime);
+	});
+
+	//Work can queue more work, which is added to the end and waits for the next frame
+	const int32 numToConsider = Items.Num();
+	int32 numRun = 0;
+	while (numRun < numToConsider)
+	{
+		//Taken out before it runs so the key can be queued again by the work itself
+		TFunction<void()> work = MoveTemp(Items[numRun].Work);
+		if (Items[numRun].Key != 0)
+		{
+			QueuedKeys.Remove(Items[numRun].Key);
+			Items[numRun].Key = 0;
+		}
+		numRun++;
+		if (work)
+		{
+			work();
+		}
+		if (FPlatformTime::Seconds() >= deadline)
+		{
+			break;
+		}
+	}
+	Items.RemoveAt(0, numRun, false);
+	return numRun;
+}
+
+void FAIWorkScheduler::Reset()
+{
+	Items.Reset();
+	QueuedKeys.Reset();
+}
@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Queue of AI work run a slice at a time under a per-frame budget. Highest priority runs first, and anything left over rolls over to the next frame with its priority raised by how long it has waited so nothing starves
+struct GUNSLINGERS_API FAIWorkScheduler
+{
+public:
+	//Queues work. A non-zero key identifies the work so queuing it again before it has run only updates its priority instead of running it twice
+	void Enqueue(uint64 key, float priority, TFunction<void()> work);
+
+	bool IsQueued(uint64 key) const { return QueuedKeys.Contains(key); }
+
+	//Runs queued work best first until budgetSeconds is used up. At least one item is always run so a tiny budget still makes progress. Returns how many items were run
+	int32 Run(double budgetSeconds);
+
+	int32 Num() const { return Items.Num(); }
+
+	void Reset();
+
+	//Priority gained per second spent waiting
+	float AgePriorityPerSecond = 1.f;
+
+private:
+	struct FWorkItem
+	{
+		uint64 Key;
+		float Priority;
+		double QueuedTime;
+		TFunction<void()> Work;
+	};
+
+	TArray<FWorkItem> Items;
+	TSet<uint64> QueuedKeys;
+};
@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BTTask_GetCoverAsync.h"
+#include "CoverObject.h"
+#include "AIController.h"
+#include "BehaviorTree/BehaviorTreeComponent.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
+
+UBTTask_GetCoverAsync::UBTTask_GetCoverAsync()
+{
+	NodeName = "Get Cover Async";
+	CoverKey.AddObjectFilter(this, GET_MEMBER_NAME_CHECKED(UBTTask_GetCoverAsync, CoverKey), AActor::StaticClass());
+	TargetKey.AddVectorFilter(this, GET_MEMBER_NAME_CHECKED(UBTTask_GetCoverAsync, TargetKey));
+	TargetKey.AllowNoneAsValue(true);
+	//The keys Enemy_Blackboard uses, so the node can replace GetCoverAndSetToTarget in Enemy_Tree without being set up
+	CoverKey.SelectedKeyName = FName(TEXT("CoverIAmIn"));
+	TargetKey.SelectedKeyName = FName(TEXT("TargetPosition"));
+}
+
+void UBTTask_GetCoverAsync::InitializeFromAsset(UBehaviorTree & Asset)
+{
+	Super::InitializeFromAsset(Asset);
+
+	UBlackboardData* blackboard = GetBlackboardAsset();
+	if (blackboard)
+	{
+		CoverKey.ResolveSelectedKey(*blackboard);
+		TargetKey.ResolveSelectedKey(*blackboard);
+	}
+}
+
+EBTNodeResult::Type UBTTask_GetCoverAsync::ExecuteTask(UBehaviorTreeComponent & OwnerComp, uint8 * NodeMemory)
+{
+	AAIController* controller = OwnerComp.GetAIOwner();
+	APawn* pawn = controller ? controller->GetPawn() : nullptr;
+	UBlackboardComponent* blackboard = OwnerComp.GetBlackboardComponent();
+	AAIDirector* director = AAIDirector::Get(pawn);
+	if (pawn == nullptr || blackboard == nullptr || director == nullptr)
+	{
+		return EBTNodeResult::Failed;
+	}
+
+	FCoverRequest request;
+	request.Position = pawn->GetActorLocation();
+	request.Forward = pawn->GetActorForwardVector();
+	request.CurrentCover = Cast<AActor>(blackboard->GetValue<UBlackboardKeyType_Object>(CoverKey.GetSelectedKeyID()));
+	request.MovementType = MovementType;
+	request.Requester = pawn;
+
+	//The node is shared by every AI running the tree, so everything about this AI goes through the component and its memory
+	TWeakObjectPtr<UBehaviorTreeComponent> weakOwnerComp(&OwnerComp);
+	FBTGetCoverAsyncMemory* memory = reinterpret_cast<FBTGetCoverAsyncMemory*>(NodeMemory);
+	memory->RequestId = director->RequestCoverAsync(request, [this, weakOwnerComp](AActor* cover)
+	{
+		UBehaviorTreeComponent* ownerComp = weakOwnerComp.Get();
+		if (ownerComp == nullptr)
+		{
+			return;
+		}
+		UBlackboardComponent* blackboard = ownerComp->GetBlackboardComponent();
+		if (cover == nullptr || blackboard == nullptr)
+		{
+			FinishLatentTask(*ownerComp, EBTNodeResult::Failed);
+			return;
+		}
+
+		blackboard->SetValue<UBlackboardKeyType_Object>(CoverKey.GetSelectedKeyID(), cover);
+		ACoverObject* coverObject = Cast<ACoverObject>(cover);
+		if (coverObject && TargetKey.IsSet())
+		{
+			blackboard->SetValue<UBlackboardKeyType_Vector>(TargetKey.GetSelectedKeyID(), coverObject->GetFurthestCoverLocationToPlayer());
+		}
+		FinishLatentTask(*ownerComp, EBTNodeResult::Succeeded);
+	});
+	return EBTNodeResult::InProgress;
+}
+
+EBTNodeResult::Type UBTTask_GetCoverAsync::AbortTask(UBehaviorTreeComponent & OwnerComp, uint8 * NodeMemory)
+{
+	FBTGetCoverAsyncMemory* memory = reinterpret_cast<FBTGetCoverAsyncMemory*>(NodeMemory);
+	AAIDirector* director = AAIDirector::Get(OwnerComp.GetAIOwner());
+	if (director)
+	{
+		director->CancelCoverRequest(memory->RequestId);
+	}
+	return EBTNodeResult::Aborted;
+}
+
+uint16 UBTTask_GetCoverAsync::GetInstanceMemorySize() const
+{
+	return sizeof(FBTGetCoverAsyncMemory);
+}
+
+FString UBTTask_GetCoverAsync::GetStaticDescription() const
+{
+	return FString::Printf(TEXT("%s: %s cover into %s"), *Super::GetStaticDescription(), *StaticEnum<MovementTypes>()->GetNameStringByValue(MovementType), *CoverKey.SelectedKeyName.ToString());
+}
@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BehaviorTree/BTTaskNode.h"
+#include "BehaviorTree/BehaviorTreeTypes.h"
+#include "AIDirector.h"
+#include "BTTask_GetCoverAsync.generated.h"
+
+//Asks the AI director for cover without stalling the game thread and writes the result to the blackboard, a native replacement for GetCoverAndSetToTarget
+UCLASS()
+class GUNSLINGERS_API UBTTask_GetCoverAsync : public UBTTaskNode
+{
+	GENERATED_BODY()
+
+public:
+	UBTTask_GetCoverAsync();
+
+	//Which kind of cover to look for
+	UPROPERTY(EditAnywhere, Category = "Cover")
+	TEnumAsByte<MovementTypes> MovementType = MovementTypes::Normal;
+
+	//Cover object the AI is in, read as the current cover and overwritten with the new one
+	UPROPERTY(EditAnywhere, Category = "Cover")
+	FBlackboardKeySelector CoverKey;
+
+	//Set to the location of the new cover's point furthest from the player, which is where the AI should move to. Optional
+	UPROPERTY(EditAnywhere, Category = "Cover")
+	FBlackboardKeySelector TargetKey;
+
+	virtual EBTNodeResult::Type ExecuteTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) override;
+	virtual EBTNodeResult::Type AbortTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) override;
+	virtual uint16 GetInstanceMemorySize() const override;
+	virtual void InitializeFromAsset(UBehaviorTree& Asset) override;
+	virtual FString GetStaticDescription() const override;
+
+protected:
+	struct FBTGetCoverAsyncMemory
+	{
+		int32 RequestId;
+	};
+};
@@ -8,10 +8,11 @@
 ACover::ACover()
 {
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bCanEverTick = false;
 
-	//Bullet mesh creation
+	//Only marks a place, nothing overlaps or collides with it
 	CollisionBox = CreateDefaultSubobject<UBoxComponent>("CollisionBox");
+	CollisionBox->SetCollisionEnabled(ECollisionEnabled::NoCollision);
 	SetRootComponent(CollisionBox);
 }
 
@@ -6,6 +6,7 @@
 #include "GameFramework/Actor.h"
 #include "Cover.generated.h"
 
+//Marker for one side of a cover object. Cover points are plain data on the cover object now, this is only kept for BP_Cover and for Blueprints that still ask for the furthest cover as an actor
 UCLASS()
 class GUNSLINGERS_API ACover : public AActor
 {
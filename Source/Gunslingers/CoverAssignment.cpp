@@ -0,0 +1,128 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverAssignment.h"
+#include "HAL/PlatformTime.h"
+
+void FCoverAssignmentProblem::Reset()
+{
+	FirstCandidate.Reset();
+	CoverIds.Reset();
+	Costs.Reset();
+}
+
+int32 FCoverAssignmentProblem::AddAgent()
+{
+	return FirstCandidate.Add(CoverIds.Num());
+}
+
+void FCoverAssignmentProblem::AddCandidate(int32 coverId, float cost)
+{
+	CoverIds.Add(coverId);
+	Costs.Add(cost);
+}
+
+bool CoverAssignment::SolveAuction(const FCoverAssignmentProblem& problem, float epsilon, double timeBudgetSeconds, TArray<int32>& outCoverIds)
+{
+	const int32 numAgents = problem.NumAgents();
+	outCoverIds.Init(INDEX_NONE, numAgents);
+	if (numAgents == 0)
+	{
+		return true;
+	}
+	const double deadline = FPlatformTime::Seconds() + timeBudgetSeconds;
+	epsilon = FMath::Max(epsilon, KINDA_SMALL_NUMBER);
+
+	//Covers are renumbered densely so prices and owners are flat arrays
+	TMap<int32, int32> objectOfCover;
+	TArray<int32> candidateObjects;
+	candidateObjects.SetNumUninitialized(problem.CoverIds.Num());
+	for (int32 c = 0; c < problem.CoverIds.Num(); c++)
+	{
+		const int32* object = objectOfCover.Find(problem.CoverIds[c]);
+		candidateObjects[c] = object ? *object : objectOfCover.Add(problem.CoverIds[c], objectOfCover.Num());
+	}
+	TArray<float> prices;
+	TArray<int32> owners;
+	prices.SetNumZeroed(objectOfCover.Num());
+	owners.Init(INDEX_NONE, objectOfCover.Num());
+
+	//Every AI also has a private option of staying put. Nobody else can bid for it so its price never rises and the auction always ends
+	TArray<int32> unassigned;
+	unassigned.Reserve(numAgents);
+	for (int32 agent = numAgents - 1; agent >= 0; agent--)
+	{
+		unassigned.Add(agent);
+	}
+
+	int32 numBids = 0;
+	while (unassigned.Num() > 0)
+	{
+		//Checking the clock every bid would cost more than the bids themselves
+		if ((++numBids & 63) == 0 && FPlatformTime::Seconds() > deadline)
+		{
+			return false;
+		}
+
+		const int32 agent = unassigned.Pop(false);
+		//Value of each option is minus its cost minus its price, find the best and second best
+		float bestValue = -problem.UnassignedCost;
+		float secondValue = -MAX_flt;
+		int32 bestCandidate = INDEX_NONE;
+		for (int32 c = problem.FirstCandidate[agent]; c < problem.GetLastCandidate(agent); c++)
+		{
+			const float value = -problem.Costs[c] - prices[candidateObjects[c]];
+			if (value > bestValue)
+			{
+				secondValue = bestValue;
+				bestValue = value;
+				bestCandidate = c;
+			}
+			else if (value > secondValue)
+			{
+				secondValue = value;
+			}
+		}
+
+		if (bestCandidate == INDEX_NONE)
+		{
+			outCoverIds[agent] = INDEX_NONE;
+			continue;
+		}
+
+		//Bid up the price by how much better the cover is than the next best option, plus epsilon so prices always rise, and outbid its current owner
+		const int32 object = candidateObjects[bestCandidate];
+		prices[object] += bestValue - secondValue + epsilon;
+		if (owners[object] != INDEX_NONE)
+		{
+			outCoverIds[owners[object]] = INDEX_NONE;
+			unassigned.Add(owners[object]);
+		}
+		owners[object] = agent;
+		outCoverIds[agent] = problem.CoverIds[bestCandidate];
+	}
+	return true;
+}
+
+void CoverAssignment::SolveGreedy(const FCoverAssignmentProblem& problem, TArray<int32>& outCoverIds)
+{
+	const int32 numAgents = problem.NumAgents();
+	outCoverIds.Init(INDEX_NONE, numAgents);
+	TSet<int32> taken;
+	for (int32 agent = 0; agent < numAgents; agent++)
+	{
+		int32 bestCandidate = INDEX_NONE;
+		for (int32 c = problem.FirstCandidate[agent]; c < problem.GetLastCandidate(agent); c++)
+		{
+			if (!taken.Contains(problem.CoverIds[c]) && (bestCandidate == INDEX_NONE || problem.Costs[c] < problem.Costs[bestCandidate]))
+			{
+				bestCandidate = c;
+			}
+		}
+		if (bestCandidate != INDEX_NONE)
+		{
+			taken.Add(problem.CoverIds[bestCandidate]);
+			outCoverIds[agent] = problem.CoverIds[bestCandidate];
+		}
+	}
+}
@@ -0,0 +1,38 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Ranked candidate covers of every AI in a squad, flattened into one array. Candidates of AI i are from FirstCandidate[i] up to the first of the next AI, best first
+struct GUNSLINGERS_API FCoverAssignmentProblem
+{
+	TArray<int32> FirstCandidate;
+	TArray<int32> CoverIds;
+	//How much worse each candidate is than the best one the AI could have had, zero for its first choice
+	TArray<float> Costs;
+
+	//Cost of an AI being given none of its candidates and staying where it is
+	float UnassignedCost = 2000.f;
+
+	void Reset();
+
+	//Starts the candidate list of the next AI, returns its index
+	int32 AddAgent();
+
+	//Adds a candidate to the last AI added
+	void AddCandidate(int32 coverId, float cost);
+
+	int32 NumAgents() const { return FirstCandidate.Num(); }
+	int32 GetLastCandidate(int32 agent) const { return FirstCandidate.IsValidIndex(agent + 1) ? FirstCandidate[agent + 1] : CoverIds.Num(); }
+};
+
+namespace CoverAssignment
+{
+	//Gives each AI at most one cover so no two share one and the total cost is within NumAgents * epsilon of the lowest possible, using Bertsekas' auction algorithm.
+	//Writes INDEX_NONE for AI left unassigned. Returns false, leaving outCoverIds unfinished, if it could not finish within timeBudgetSeconds
+	GUNSLINGERS_API bool SolveAuction(const FCoverAssignmentProblem& problem, float epsilon, double timeBudgetSeconds, TArray<int32>& outCoverIds);
+
+	//Each AI in order takes its best candidate that an earlier AI has not taken, however much it costs
+	GUNSLINGERS_API void SolveGreedy(const FCoverAssignmentProblem& problem, TArray<int32>& outCoverIds);
+}
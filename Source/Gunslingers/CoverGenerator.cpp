@@ -0,0 +1,519 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverGenerator.h"
+#include "InstancedCoverObject.h"
+#include "Engine/World.h"
+#include "NavigationSystem.h"
+#include "NavMesh/RecastNavMesh.h"
+#include "Async/ParallelFor.h"
+#include "Misc/Crc.h"
+#if WITH_RECAST
+#include "Detour/DetourNavMesh.h"
+#endif
+
+namespace
+{
+	//Edges this close to pointing the same way are joined into one
+	const float EdgeJoinCos = 0.98f;
+
+	FIntVector QuantizeEdgePoint(const FVector& point)
+	{
+		return FIntVector(FMath::RoundToInt(point.X), FMath::RoundToInt(point.Y), FMath::RoundToInt(point.Z));
+	}
+}
+
+// Sets default values
+ACoverGenerator::ACoverGenerator()
+{
+ 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+void ACoverGenerator::BeginPlay()
+{
+	Super::BeginPlay();
+
+	//A navmesh built at runtime is not there yet, its tiles are picked up when it finishes
+	UNavigationSystemV1* navSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (navSys)
+	{
+		navSys->OnNavigationGenerationFinishedDelegate.AddDynamic(this, &ACoverGenerator::OnNavigationGenerationFinished);
+	}
+	Rebuild();
+}
+
+void ACoverGenerator::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	UNavigationSystemV1* navSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (navSys)
+	{
+		navSys->OnNavigationGenerationFinishedDelegate.RemoveDynamic(this, &ACoverGenerator::OnNavigationGenerationFinished);
+	}
+	Jobs.Reset();
+	Scanning = false;
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ACoverGenerator::OnNavigationGenerationFinished(ANavigationData* navData)
+{
+	Rebuild();
+}
+
+void ACoverGenerator::Rebuild()
+{
+	if (!IsBuilding())
+	{
+		BuildStartTime = FPlatformTime::Seconds();
+	}
+	Scanning = true;
+	ScanCursor = 0;
+	//Tiles being worked on may have changed again, they are looked at once their job is done
+	for (FTileCover& tile : Tiles)
+	{
+		tile.NeedsRescan |= tile.JobInFlight;
+	}
+}
+
+bool ACoverGenerator::GatherBoundaryEdges(const ARecastNavMesh& navMesh, int32 tileIndex, TArray<FBoundaryEdge>& outEdges) const
+{
+#if WITH_RECAST
+	const dtNavMesh* detourMesh = navMesh.GetRecastMesh();
+	const dtMeshTile* tile = detourMesh ? detourMesh->getTile(tileIndex) : nullptr;
+	if (tile == nullptr || tile->header == nullptr)
+	{
+		return false;
+	}
+
+	for (int32 p = 0; p < tile->header->polyCount; p++)
+	{
+		const dtPoly& poly = tile->polys[p];
+		if (poly.getType() != DT_POLYTYPE_GROUND)
+		{
+			continue;
+		}
+
+		FVector center = FVector::ZeroVector;
+		for (int32 v = 0; v < poly.vertCount; v++)
+		{
+			center += Recast2UnrealPoint(&tile->verts[poly.verts[v] * 3]);
+		}
+		center /= poly.vertCount;
+
+		for (int32 v = 0; v < poly.vertCount; v++)
+		{
+			//Edges on the border of the tile are only boundaries if they have no link into the next tile
+			if (poly.neis[v] & DT_EXT_LINK)
+			{
+				bool linked = false;
+				for (unsigned int link = poly.firstLink; link != DT_NULL_LINK; link = tile->links[link].next)
+				{
+					if (tile->links[link].edge == v)
+					{
+						linked = true;
+						break;
+					}
+				}
+				if (linked)
+				{
+					continue;
+				}
+			}
+			else if (poly.neis[v] != 0)
+			{
+				continue;
+			}
+
+			FBoundaryEdge edge;
+			edge.Start = Recast2UnrealPoint(&tile->verts[poly.verts[v] * 3]);
+			edge.End = Recast2UnrealPoint(&tile->verts[poly.verts[(v + 1) % poly.vertCount] * 3]);
+			const FVector along = (edge.End - edge.Start).GetSafeNormal2D();
+			edge.Outward = FVector(along.Y, -along.X, 0.f);
+			//Whichever way the polygons are wound, outward is away from the middle of the polygon
+			if (((0.5f * (edge.Start + edge.End) - center) | edge.Outward) < 0.f)
+			{
+				edge.Outward = -edge.Outward;
+			}
+			outEdges.Add(edge);
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void ACoverGenerator::SampleEdges(FTileJob& job) const
+{
+	//Edges are split wherever polygons meet, join the ones that carry straight on so a wall is one long edge
+	TMap<FIntVector, int32> edgesByStart;
+	for (int32 i = 0; i < job.Edges.Num(); i++)
+	{
+		edgesByStart.Add(QuantizeEdgePoint(job.Edges[i].Start), i);
+	}
+	//The edge that carries straight on from each edge, if any
+	TArray<int32> nextEdges;
+	TBitArray<> carriedInto(false, job.Edges.Num());
+	nextEdges.Init(INDEX_NONE, job.Edges.Num());
+	for (int32 i = 0; i < job.Edges.Num(); i++)
+	{
+		const int32* next = edgesByStart.Find(QuantizeEdgePoint(job.Edges[i].End));
+		const FVector direction = (job.Edges[i].End - job.Edges[i].Start).GetSafeNormal();
+		if (next && *next != i && ((job.Edges[*next].End - job.Edges[*next].Start).GetSafeNormal() | direction) >= EdgeJoinCos)
+		{
+			nextEdges[i] = *next;
+			carriedInto[*next] = true;
+		}
+	}
+
+	//Chains are started from edges nothing carries on into first, so only straight loops are left to start anywhere
+	TBitArray<> joined(false, job.Edges.Num());
+	TArray<FBoundaryEdge> edges;
+	for (int32 pass = 0; pass < 2; pass++)
+	{
+		for (int32 i = 0; i < job.Edges.Num(); i++)
+		{
+			if (joined[i] || (pass == 0 && carriedInto[i]))
+			{
+				continue;
+			}
+			FBoundaryEdge edge = job.Edges[i];
+			joined[i] = true;
+			for (int32 next = nextEdges[i]; next != INDEX_NONE && !joined[next]; next = nextEdges[next])
+			{
+				joined[next] = true;
+				edge.End = job.Edges[next].End;
+			}
+			edges.Add(edge);
+		}
+	}
+	job.Edges = MoveTemp(edges);
+
+	for (int32 i = 0; i < job.Edges.Num(); i++)
+	{
+		const FBoundaryEdge& edge = job.Edges[i];
+		const float length = FVector::Dist(edge.Start, edge.End);
+		const int32 numSamples = FMath::Max(FMath::FloorToInt(length / SampleSpacing), 1);
+		for (int32 k = 0; k < numSamples; k++)
+		{
+			FSample sample;
+			sample.Location = FMath::Lerp(edge.Start, edge.End, (k + 0.5f) / numSamples);
+			sample.Outward = edge.Outward;
+			sample.Edge = i;
+			job.Samples.Add(sample);
+		}
+	}
+}
+
+void ACoverGenerator::StartTraces(FTileJob& job, bool high)
+{
+	UWorld* world = GetWorld();
+	job.Traces.Reset();
+	job.TraceSamples.Reset();
+
+	//Only the level's geometry counts, cover objects already provide their own cover points
+	static const FName TraceTag(TEXT("CoverGenerator"));
+	FCollisionQueryParams params(TraceTag, false, this);
+	FCollisionObjectQueryParams objectParams;
+	objectParams.AddObjectTypesToQuery(ECC_WorldStatic);
+	objectParams.AddObjectTypesToQuery(ECC_WorldDynamic);
+
+	const float height = high ? HighTraceHeight : LowTraceHeight;
+	for (int32 i = 0; i < job.Samples.Num(); i++)
+	{
+		//There is no high cover where there is not low cover
+		if (high && !job.Samples[i].Low)
+		{
+			continue;
+		}
+		const FVector start = job.Samples[i].Location + FVector(0.f, 0.f, height);
+		const FVector end = start + job.Samples[i].Outward * ObstacleProbeDistance;
+		job.Traces.Add(world->AsyncLineTraceByObjectType(EAsyncTraceType::Single, start, end, objectParams, params));
+		job.TraceSamples.Add(i);
+	}
+	TracesStartedThisFrame += job.Traces.Num();
+}
+
+bool ACoverGenerator::CollectTraces(FTileJob& job, bool high)
+{
+	UWorld* world = GetWorld();
+	//Results are only kept for the frame after they are queued, so every trace is read back the first time they are all there
+	FTraceDatum datum;
+	for (const FTraceHandle& trace : job.Traces)
+	{
+		if (world->IsTraceHandleValid(trace, false) && !world->QueryTraceData(trace, datum))
+		{
+			return false;
+		}
+	}
+
+	for (int32 i = 0; i < job.Traces.Num(); i++)
+	{
+		bool hit = false;
+		if (world->QueryTraceData(job.Traces[i], datum))
+		{
+			for (const FHitResult& result : datum.OutHits)
+			{
+				if (result.bBlockingHit && !Cast<ACoverObject>(result.GetActor()) && !Cast<AInstancedCoverObject>(result.GetActor()))
+				{
+					hit = true;
+					break;
+				}
+			}
+		}
+		FSample& sample = job.Samples[job.TraceSamples[i]];
+		(high ? sample.High : sample.Low) = hit;
+	}
+	job.Traces.Reset();
+	job.TraceSamples.Reset();
+	return true;
+}
+
+void ACoverGenerator::ClearTile(FTileCover& tile)
+{
+	for (const TWeakObjectPtr<ACoverObject>& coverObject : tile.CoverObjects)
+	{
+		//Unregisters itself from the AI director on EndPlay
+		if (coverObject.IsValid())
+		{
+			coverObject->Destroy();
+		}
+	}
+	tile.CoverObjects.Reset();
+	NumCoverPoints -= tile.NumCoverPoints;
+	tile.NumCoverPoints = 0;
+}
+
+void ACoverGenerator::EmitCover(FTileJob& job)
+{
+	//Each sample stands for an equal share of its edge
+	TArray<int32> edgeSampleCounts;
+	edgeSampleCounts.SetNumZeroed(job.Edges.Num());
+	for (const FSample& sample : job.Samples)
+	{
+		edgeSampleCounts[sample.Edge]++;
+	}
+
+	//Runs of samples along one edge with the same height of cover become one cover point
+	TArray<FCoverPoint> points;
+	int32 runStart = 0;
+	for (int32 i = 0; i <= job.Samples.Num(); i++)
+	{
+		const bool runEnds = i == job.Samples.Num()
+			|| job.Samples[i].Edge != job.Samples[runStart].Edge
+			|| job.Samples[i].Low != job.Samples[runStart].Low
+			|| job.Samples[i].High != job.Samples[runStart].High;
+		if (!runEnds)
+		{
+			continue;
+		}
+
+		const FSample& first = job.Samples[runStart];
+		if (first.Low)
+		{
+			const FBoundaryEdge& edge = job.Edges[first.Edge];
+			const float length = FVector::Dist(edge.Start, edge.End) * (i - runStart) / edgeSampleCounts[first.Edge];
+			if (length >= MinCoverLength)
+			{
+				FCoverPoint point;
+				point.Location = 0.5f * (job.Samples[runStart].Location + job.Samples[i - 1].Location);
+				//Facing the cover, the same as the points around cover meshes
+				point.Rotation = FRotationMatrix::MakeFromX(first.Outward).Rotator();
+				point.Height = first.High ? CoverHeights::HighCover : CoverHeights::LowCover;
+				point.Extent = FVector(0.5f * ObstacleProbeDistance, 0.5f * length, 0.5f * (first.High ? HighTraceHeight : LowTraceHeight));
+				points.Add(point);
+			}
+		}
+		runStart = i;
+	}
+
+	//Group nearby points so the director ranks a few cover objects rather than every point
+	TArray<TArray<FCoverPoint>> clusters;
+	TArray<FVector> clusterSums;
+	const float clusterRadiusSquared = ClusterRadius * ClusterRadius;
+	for (const FCoverPoint& point : points)
+	{
+		int32 cluster = INDEX_NONE;
+		for (int32 c = 0; c < clusters.Num(); c++)
+		{
+			if (FVector::DistSquared(clusterSums[c] / clusters[c].Num(), point.Location) <= clusterRadiusSquared)
+			{
+				cluster = c;
+				break;
+			}
+		}
+		if (cluster == INDEX_NONE)
+		{
+			cluster = clusters.AddDefaulted();
+			clusterSums.Add(FVector::ZeroVector);
+		}
+		clusters[cluster].Add(point);
+		clusterSums[cluster] += point.Location;
+	}
+
+	FTileCover& tile = Tiles[job.TileIndex];
+	ClearTile(tile);
+	tile.Hash = job.Hash;
+
+	//The points are on the navmesh edge, which is already the agent's radius away from the cover
+	UNavigationSystemV1* navSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	const ARecastNavMesh* navMesh = navSys ? Cast<ARecastNavMesh>(navSys->GetDefaultNavDataInstance(FNavigationSystem::DontCreate)) : nullptr;
+	for (int32 c = 0; c < clusters.Num(); c++)
+	{
+		ACoverObject* coverObject = ACoverObject::SpawnWithCoverPoints(GetWorld(), clusterSums[c] / clusters[c].Num(), clusters[c], this);
+		if (coverObject == nullptr)
+		{
+			continue;
+		}
+		if (navMesh)
+		{
+			coverObject->CoverRange = navMesh->AgentRadius;
+		}
+		tile.CoverObjects.Add(coverObject);
+		tile.NumCoverPoints += coverObject->CoverPoints.Num();
+	}
+	NumCoverPoints += tile.NumCoverPoints;
+}
+
+// Called every frame
+void ACoverGenerator::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (!IsBuilding())
+	{
+		return;
+	}
+	TracesStartedThisFrame = 0;
+	const double deadline = FPlatformTime::Seconds() + FrameBudget / 1000.0;
+
+	//Every job's traces are read back this frame whatever the budget, they are gone by the next
+	for (FTileJob& job : Jobs)
+	{
+		if (job.Stage == EJobStage::ReadyToEmit || !CollectTraces(job, job.Stage == EJobStage::HighTraces))
+		{
+			continue;
+		}
+		if (job.Stage == EJobStage::LowTraces)
+		{
+			StartTraces(job, true);
+			job.Stage = job.Traces.Num() > 0 ? EJobStage::HighTraces : EJobStage::ReadyToEmit;
+		}
+		else
+		{
+			job.Stage = EJobStage::ReadyToEmit;
+		}
+	}
+
+	//Spawning cover objects is the expensive part on the game thread, so it is spread out, at least one tile a frame
+	bool rescan = false;
+	for (int32 i = 0; i < Jobs.Num();)
+	{
+		if (Jobs[i].Stage != EJobStage::ReadyToEmit)
+		{
+			i++;
+			continue;
+		}
+		EmitCover(Jobs[i]);
+		FTileCover& tile = Tiles[Jobs[i].TileIndex];
+		tile.JobInFlight = false;
+		rescan |= tile.NeedsRescan;
+		tile.NeedsRescan = false;
+		Jobs.RemoveAtSwap(i, 1, false);
+		if (FPlatformTime::Seconds() >= deadline)
+		{
+			break;
+		}
+	}
+
+	//Read tiles until the budget or the traces for the frame run out
+	UNavigationSystemV1* navSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	const ARecastNavMesh* navMesh = navSys ? Cast<ARecastNavMesh>(navSys->GetDefaultNavDataInstance(FNavigationSystem::DontCreate)) : nullptr;
+#if WITH_RECAST
+	const dtNavMesh* detourMesh = navMesh ? navMesh->GetRecastMesh() : nullptr;
+#else
+	const void* detourMesh = nullptr;
+#endif
+	if (Scanning && detourMesh == nullptr)
+	{
+		Scanning = false;
+	}
+	else if (Scanning)
+	{
+#if WITH_RECAST
+		//A new navmesh can have a different number of tiles, everything emitted for the old one is replaced
+		if (Tiles.Num() != detourMesh->getMaxTiles())
+		{
+			for (FTileCover& tile : Tiles)
+			{
+				ClearTile(tile);
+			}
+			Jobs.Reset();
+			Tiles.Reset();
+			Tiles.SetNum(detourMesh->getMaxTiles());
+			ScanCursor = 0;
+		}
+#endif
+
+		TArray<FTileJob> newJobs;
+		int32 estimatedTraces = 0;
+		while (ScanCursor < Tiles.Num() && FPlatformTime::Seconds() < deadline)
+		{
+			if (newJobs.Num() > 0 && TracesStartedThisFrame + estimatedTraces >= MaxTracesPerFrame)
+			{
+				break;
+			}
+			const int32 tileIndex = ScanCursor++;
+			FTileCover& tile = Tiles[tileIndex];
+			if (tile.JobInFlight)
+			{
+				continue;
+			}
+
+			TArray<FBoundaryEdge> edges;
+			GatherBoundaryEdges(*navMesh, tileIndex, edges);
+			const uint32 hash = edges.Num() > 0 ? FCrc::MemCrc32(edges.GetData(), edges.Num() * sizeof(FBoundaryEdge)) : 0;
+			if (hash == tile.Hash)
+			{
+				continue;
+			}
+
+			FTileJob& job = newJobs.AddDefaulted_GetRef();
+			job.TileIndex = tileIndex;
+			job.Hash = hash;
+			for (const FBoundaryEdge& edge : edges)
+			{
+				estimatedTraces += FMath::Max(FMath::FloorToInt(FVector::Dist(edge.Start, edge.End) / SampleSpacing), 1);
+			}
+			job.Edges = MoveTemp(edges);
+			tile.JobInFlight = true;
+		}
+		if (ScanCursor >= Tiles.Num())
+		{
+			Scanning = false;
+		}
+
+		//Each tile is sampled on its own worker, then its low traces are queued
+		ParallelFor(newJobs.Num(), [&](int32 i)
+		{
+			SampleEdges(newJobs[i]);
+		});
+		for (FTileJob& job : newJobs)
+		{
+			StartTraces(job, false);
+			job.Stage = job.Traces.Num() > 0 ? EJobStage::LowTraces : EJobStage::ReadyToEmit;
+			Jobs.Add(MoveTemp(job));
+		}
+	}
+
+	//A scan already under way may have gone past those tiles while they were busy
+	if (rescan)
+	{
+		Rebuild();
+	}
+	if (!IsBuilding())
+	{
+		UE_LOG(LogTemp, Display, TEXT("Generated %d cover points from the navmesh in %.2f seconds"), NumCoverPoints, FPlatformTime::Seconds() - BuildStartTime);
+	}
+}
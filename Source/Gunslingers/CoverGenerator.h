@@ -0,0 +1,156 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "WorldCollision.h"
+#include "CoverObject.h"
+#include "CoverGenerator.generated.h"
+
+//Placed once in a level to find cover on its own, so large maps do not need cover objects placed by hand. It walks the edges of the navmesh, traces out from them to see if there is something low or high to hide behind,
+//and emits what it finds as cover objects with no mesh that register with the AI director like any other. Only tiles whose edges have changed are worked on again when the navmesh is rebuilt
+UCLASS()
+class GUNSLINGERS_API ACoverGenerator : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	ACoverGenerator();
+
+	//Distance between the points traced along each navmesh edge
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Cover")
+	float SampleSpacing = 50.f;
+
+	//How far out from the navmesh edge something has to be to count as cover
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Cover")
+	float ObstacleProbeDistance = 80.f;
+
+	//Heights above the navmesh the low and high traces are made at. Something at the low height only is low cover, something at both is high cover
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Cover")
+	float LowTraceHeight = 60.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Cover")
+	float HighTraceHeight = 150.f;
+
+	//Runs of cover shorter than this are too small to hide behind
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Cover")
+	float MinCoverLength = 80.f;
+
+	//Cover points within this distance of each other are put in the same cover object, which is what the AI director ranks
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Cover")
+	float ClusterRadius = 400.f;
+
+	//Most time in milliseconds spent reading the navmesh and emitting cover each frame
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Cover")
+	float FrameBudget = 1.f;
+
+	//Most traces started each frame for new tiles, at least one tile is always started so the build keeps moving
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Cover")
+	int32 MaxTracesPerFrame = 2048;
+
+	//Looks at every tile of the navmesh again, tiles that have not changed are skipped without tracing. Called automatically on BeginPlay and whenever the navmesh finishes building
+	UFUNCTION(BlueprintCallable, Category = "Cover")
+	void Rebuild();
+
+	UFUNCTION(BlueprintPure, Category = "Cover")
+	bool IsBuilding() const { return Scanning || Jobs.Num() > 0; }
+
+	//Cover points emitted by the generator so far
+	UFUNCTION(BlueprintPure, Category = "Cover")
+	int32 GetNumCoverPoints() const { return NumCoverPoints; }
+
+protected:
+	//A navmesh edge with nothing on the other side of it
+	struct FBoundaryEdge
+	{
+		FVector Start;
+		FVector End;
+		//Away from the navmesh, towards whatever stopped it
+		FVector Outward;
+	};
+
+	//A point along a boundary edge that is traced from
+	struct FSample
+	{
+		FVector Location;
+		FVector Outward;
+		int32 Edge;
+		//Whether the low and high traces out from it hit something
+		bool Low = false;
+		bool High = false;
+	};
+
+	enum class EJobStage : uint8
+	{
+		LowTraces,
+		HighTraces,
+		ReadyToEmit
+	};
+
+	//One tile being worked on, it waits for its low traces and then for its high traces before its cover is emitted
+	struct FTileJob
+	{
+		int32 TileIndex;
+		uint32 Hash;
+		EJobStage Stage = EJobStage::LowTraces;
+		TArray<FBoundaryEdge> Edges;
+		//In edge order, the samples of each edge are next to each other
+		TArray<FSample> Samples;
+		TArray<FTraceHandle> Traces;
+		//Which sample each trace belongs to
+		TArray<int32> TraceSamples;
+	};
+
+	//What was last emitted for each navmesh tile
+	struct FTileCover
+	{
+		uint32 Hash = 0;
+		TArray<TWeakObjectPtr<ACoverObject>> CoverObjects;
+		int32 NumCoverPoints = 0;
+		//The tile changed while a job for it was in flight, so it has to be looked at again when that finishes
+		bool NeedsRescan = false;
+		bool JobInFlight = false;
+	};
+
+	TArray<FTileCover> Tiles;
+	TArray<FTileJob> Jobs;
+
+	bool Scanning = false;
+	int32 ScanCursor = 0;
+	double BuildStartTime = 0.0;
+	int32 NumCoverPoints = 0;
+	int32 TracesStartedThisFrame = 0;
+
+	//Reads the boundary edges of one tile of the navmesh, returns false if there is no tile there
+	bool GatherBoundaryEdges(const class ARecastNavMesh& navMesh, int32 tileIndex, TArray<FBoundaryEdge>& outEdges) const;
+
+	//Joins edges that carry straight on from each other and spaces samples along them. Only touches the job so jobs can be sampled in parallel
+	void SampleEdges(FTileJob& job) const;
+
+	//Queues a trace out from each sample that needs one at height
+	void StartTraces(FTileJob& job, bool high);
+
+	//Reads back a job's traces, returns false if they have not finished
+	bool CollectTraces(FTileJob& job, bool high);
+
+	//Turns runs of samples with cover into cover points, clusters them and replaces the tile's cover objects with them
+	void EmitCover(FTileJob& job);
+
+	void ClearTile(FTileCover& tile);
+
+	UFUNCTION()
+	void OnNavigationGenerationFinished(class ANavigationData* navData);
+
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+
+	// Called when removed from the world
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+	// Called every frame
+	virtual void Tick(float DeltaTime) override;
+
+};
@@ -0,0 +1,140 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverInfluenceMap.h"
+#include "DrawDebugHelpers.h"
+
+FCoverInfluenceMap::FCoverInfluenceMap()
+	: Origin(FVector2D::ZeroVector)
+	, CellSize(200.f)
+	, Size(0)
+	, HalfLife(1.f)
+	, Time(0.f)
+	, Stride(0)
+	, NextDecayRow(0)
+{
+}
+
+void FCoverInfluenceMap::Reset(const FVector& center, float InCellSize, int32 numCellsPerSide, float InHalfLife)
+{
+	CellSize = FMath::Max(InCellSize, 1.f);
+	Size = FMath::Max(numCellsPerSide, 0);
+	HalfLife = FMath::Max(InHalfLife, KINDA_SMALL_NUMBER);
+	Origin = FVector2D(center) - FVector2D(0.5f * Size * CellSize, 0.5f * Size * CellSize);
+	Time = 0.f;
+	Stride = Align(Size, 4);
+	Values.Reset();
+	Values.SetNumZeroed(Stride * Size);
+	RowTimes.Reset();
+	RowTimes.SetNumZeroed(Size);
+	NextDecayRow = 0;
+}
+
+bool FCoverInfluenceMap::GetCell(const FVector& location, int32& outX, int32& outY) const
+{
+	outX = FMath::FloorToInt((location.X - Origin.X) / CellSize);
+	outY = FMath::FloorToInt((location.Y - Origin.Y) / CellSize);
+	return outX >= 0 && outX < Size && outY >= 0 && outY < Size;
+}
+
+void FCoverInfluenceMap::DecayRow(int32 row)
+{
+	const float elapsed = Time - RowTimes[row];
+	if (elapsed <= 0.f)
+	{
+		return;
+	}
+	RowTimes[row] = Time;
+
+	const VectorRegister factor = VectorSetFloat1(FMath::Exp2(-elapsed / HalfLife));
+	float* values = Values.GetData() + row * Stride;
+	for (int32 i = 0; i < Stride; i += 4)
+	{
+		VectorStore(VectorMultiply(VectorLoad(values + i), factor), values + i);
+	}
+}
+
+void FCoverInfluenceMap::Stamp(const FVector& location, float radius, float amount)
+{
+	if (Size == 0 || radius <= 0.f)
+	{
+		return;
+	}
+
+	const int32 lowX = FMath::Max(FMath::FloorToInt((location.X - radius - Origin.X) / CellSize), 0);
+	const int32 lowY = FMath::Max(FMath::FloorToInt((location.Y - radius - Origin.Y) / CellSize), 0);
+	const int32 highX = FMath::Min(FMath::FloorToInt((location.X + radius - Origin.X) / CellSize), Size - 1);
+	const int32 highY = FMath::Min(FMath::FloorToInt((location.Y + radius - Origin.Y) / CellSize), Size - 1);
+
+	for (int32 y = lowY; y <= highY; y++)
+	{
+		//The row has to be caught up first, otherwise the new danger would be decayed for time that passed before it was added
+		DecayRow(y);
+		float* values = Values.GetData() + y * Stride;
+		for (int32 x = lowX; x <= highX; x++)
+		{
+			const FVector2D cellCenter = Origin + FVector2D((x + 0.5f) * CellSize, (y + 0.5f) * CellSize);
+			const float distance = (cellCenter - FVector2D(location)).Size();
+			if (distance < radius)
+			{
+				values[x] += amount * (1.f - distance / radius);
+			}
+		}
+	}
+}
+
+float FCoverInfluenceMap::Sample(const FVector& location) const
+{
+	int32 x, y;
+	if (!GetCell(location, x, y))
+	{
+		return 0.f;
+	}
+	return Values[y * Stride + x] * FMath::Exp2(-(Time - RowTimes[y]) / HalfLife);
+}
+
+int32 FCoverInfluenceMap::Decay(int32 maxCells)
+{
+	if (Size == 0)
+	{
+		return 0;
+	}
+
+	//Always at least one row so the map keeps moving however small the budget
+	int32 numCells = 0;
+	int32 numRows = 0;
+	do
+	{
+		DecayRow(NextDecayRow);
+		NextDecayRow = (NextDecayRow + 1) % Size;
+		numCells += Size;
+		numRows++;
+	} while (numCells < maxCells && numRows < Size);
+	return numCells;
+}
+
+void FCoverInfluenceMap::DrawDebug(UWorld* world, float height, float maxValue) const
+{
+	if (world == nullptr || maxValue <= 0.f)
+	{
+		return;
+	}
+
+	const FVector extent(0.45f * CellSize, 0.45f * CellSize, 1.f);
+	for (int32 y = 0; y < Size; y++)
+	{
+		const float rowFactor = FMath::Exp2(-(Time - RowTimes[y]) / HalfLife);
+		for (int32 x = 0; x < Size; x++)
+		{
+			const float value = Values[y * Stride + x] * rowFactor;
+			if (value < KINDA_SMALL_NUMBER)
+			{
+				continue;
+			}
+			const float alpha = FMath::Min(value / maxValue, 1.f);
+			const FColor color = FLinearColor::LerpUsingHSV(FLinearColor::Yellow, FLinearColor::Red, alpha).ToFColor(true);
+			const FVector center(Origin.X + (x + 0.5f) * CellSize, Origin.Y + (y + 0.5f) * CellSize, height);
+			DrawDebugSolidBox(world, center, extent, color);
+		}
+	}
+}
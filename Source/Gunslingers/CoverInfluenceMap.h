@@ -0,0 +1,51 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Square 2D grid of how dangerous each part of the level has been recently. Events stamp danger into it and it halves every HalfLife seconds.
+//Rows are decayed a few at a time to stay within a budget, each row remembers when it was last decayed so samples are exact whichever rows have been caught up
+struct GUNSLINGERS_API FCoverInfluenceMap
+{
+public:
+	FCoverInfluenceMap();
+
+	//Clears the map and covers the square of numCellsPerSide cells centred on center
+	void Reset(const FVector& center, float InCellSize, int32 numCellsPerSide, float InHalfLife);
+
+	void AdvanceTime(float deltaTime) { Time += deltaTime; }
+
+	//Adds amount at location, falling off to nothing at radius. Anything outside the map is ignored
+	void Stamp(const FVector& location, float radius, float amount);
+
+	//Danger at the cell location is in, zero outside the map
+	float Sample(const FVector& location) const;
+
+	//Decays rows oldest first until about maxCells cells have been done, returns how many were
+	int32 Decay(int32 maxCells);
+
+	//Draws every cell with any danger as a box shaded from yellow to red, at full red when it reaches maxValue
+	void DrawDebug(class UWorld* world, float height, float maxValue) const;
+
+	float GetCellSize() const { return CellSize; }
+	int32 GetNumCellsPerSide() const { return Size; }
+
+private:
+	//Multiplies a row by however much it should have decayed since it was last done
+	void DecayRow(int32 row);
+
+	bool GetCell(const FVector& location, int32& outX, int32& outY) const;
+
+	FVector2D Origin;
+	float CellSize;
+	int32 Size;
+	float HalfLife;
+	float Time;
+
+	//Rows are padded to a multiple of four floats so they can be decayed four cells per instruction with no scalar tail
+	int32 Stride;
+	TArray<float> Values;
+	TArray<float> RowTimes;
+	int32 NextDecayRow;
+};
@@ -0,0 +1,232 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverLevelData.h"
+#include "CoverObject.h"
+#include "InstancedCoverObject.h"
+#include "AIDirector.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/Pawn.h"
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	//Bit of the packed upper triangle that holds the pair (a, b), a must be less than b
+	int64 GetPairBit(int32 a, int32 b, int32 numCoverPoints)
+	{
+		return (int64)a * (2 * (int64)numCoverPoints - a - 1) / 2 + (b - a - 1);
+	}
+}
+
+// Sets default values
+ACoverLevelData::ACoverLevelData()
+{
+	PrimaryActorTick.bCanEverTick = false;
+}
+
+void ACoverLevelData::BakeCoverPoints()
+{
+	UWorld* world = GetWorld();
+	if (world == nullptr)
+	{
+		return;
+	}
+
+	int32 numCoverPoints = 0;
+	for (TActorIterator<ACoverObject> it(world); it; ++it)
+	{
+		it->BakeCoverPoints();
+		numCoverPoints += it->CoverPoints.Num();
+	}
+	for (TActorIterator<AInstancedCoverObject> it(world); it; ++it)
+	{
+		it->BakeCoverPoints();
+		for (const FInstancedCoverSection& section : it->Sections)
+		{
+			numCoverPoints += section.CoverPoints.Num();
+		}
+	}
+	UE_LOG(LogTemp, Display, TEXT("Baked %d cover points"), numCoverPoints);
+
+	BakeVisibility();
+}
+
+void ACoverLevelData::BakeVisibility()
+{
+	UWorld* world = GetWorld();
+	if (world == nullptr)
+	{
+		return;
+	}
+
+	Modify();
+	BakedCoverObjects.Reset();
+	FirstCoverPoints.Reset();
+	VisibilityBits.Reset();
+
+	//Gather every cover point in the level, raised to the height a character would look out from
+	TArray<FVector> eyes;
+	for (TActorIterator<ACoverObject> it(world); it; ++it)
+	{
+		//Visibility is indexed by the points the cover object will have at runtime, so they have to be baked too
+		if (!it->HasCurrentBake())
+		{
+			it->BakeCoverPoints();
+		}
+		BakedCoverObjects.Add(TSoftObjectPtr<ACoverObject>(*it));
+		FirstCoverPoints.Add(eyes.Num());
+		for (const FCoverPoint& point : it->CoverPoints)
+		{
+			eyes.Add(point.Location + FVector(0.f, 0.f, TraceHeight));
+		}
+	}
+	NumCoverPoints = eyes.Num();
+
+	//Only the geometry should block, not characters that happen to be placed in the level
+	FCollisionQueryParams params(FName(TEXT("CoverVisibilityBake")), false);
+	for (TActorIterator<APawn> it(world); it; ++it)
+	{
+		params.AddIgnoredActor(*it);
+	}
+
+	//Each row of the matrix is traced on its own worker into its own bits so no locking is needed, then they are packed together
+	TArray<TBitArray<>> rows;
+	rows.SetNum(NumCoverPoints);
+	ParallelFor(NumCoverPoints, [&](int32 a)
+	{
+		TBitArray<>& row = rows[a];
+		row.Init(false, NumCoverPoints - a - 1);
+		for (int32 b = a + 1; b < NumCoverPoints; b++)
+		{
+			row[b - a - 1] = !world->LineTraceTestByChannel(eyes[a], eyes[b], ECC_Visibility, params);
+		}
+	});
+
+	const int64 numPairs = (int64)NumCoverPoints * (NumCoverPoints - 1) / 2;
+	VisibilityBits.SetNumZeroed((int32)((numPairs + 31) / 32));
+	int32 numVisible = 0;
+	for (int32 a = 0; a < NumCoverPoints; a++)
+	{
+		for (TConstSetBitIterator<> it(rows[a]); it; ++it)
+		{
+			const int64 bit = GetPairBit(a, a + 1 + it.GetIndex(), NumCoverPoints);
+			VisibilityBits[bit >> 5] |= 1u << (bit & 31);
+			numVisible++;
+		}
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Baked cover visibility: %d cover objects, %d cover points, %d of %lld pairs visible, %d bytes"),
+		BakedCoverObjects.Num(), NumCoverPoints, numVisible, numPairs, VisibilityBits.Num() * (int32)sizeof(uint32));
+}
+
+bool ACoverLevelData::IsVisible(int32 coverPointA, int32 coverPointB) const
+{
+	if (coverPointA == coverPointB)
+	{
+		return true;
+	}
+	if (coverPointA > coverPointB)
+	{
+		Swap(coverPointA, coverPointB);
+	}
+	checkSlow(coverPointA >= 0 && coverPointB < NumCoverPoints);
+	const int64 bit = GetPairBit(coverPointA, coverPointB, NumCoverPoints);
+	return (VisibilityBits[bit >> 5] & (1u << (bit & 31))) != 0;
+}
+
+int32 ACoverLevelData::GetBakedIndex(const AActor * coverObject) const
+{
+	const int32* index = coverObject ? BakedIndices.Find(FSoftObjectPath(coverObject)) : nullptr;
+	return index ? *index : INDEX_NONE;
+}
+
+int32 ACoverLevelData::GetCoverPointIndex(const FCoverPointRef& cover) const
+{
+	//Cover points are baked in the same order the cover object holds them
+	int32 bakedIndex = GetBakedIndex(cover.CoverObject);
+	if (bakedIndex == INDEX_NONE)
+	{
+		return INDEX_NONE;
+	}
+	int32 localIndex = cover.Index;
+	int32 lastCoverPoint = BakedCoverObjects.IsValidIndex(bakedIndex + 1) ? FirstCoverPoints[bakedIndex + 1] : NumCoverPoints;
+	if (localIndex == INDEX_NONE || FirstCoverPoints[bakedIndex] + localIndex >= lastCoverPoint)
+	{
+		return INDEX_NONE;
+	}
+	return FirstCoverPoints[bakedIndex] + localIndex;
+}
+
+bool ACoverLevelData::IsCoverObjectExposedTo(int32 bakedIndex, int32 coverPoint) const
+{
+	int32 lastCoverPoint = BakedCoverObjects.IsValidIndex(bakedIndex + 1) ? FirstCoverPoints[bakedIndex + 1] : NumCoverPoints;
+	const ACoverObject* coverObject = BakedCoverObjects[bakedIndex].Get();
+	for (int32 point = FirstCoverPoints[bakedIndex]; point < lastCoverPoint; point++)
+	{
+		//A side that has been shot apart gives no cover however well hidden it was
+		const int32 localIndex = point - FirstCoverPoints[bakedIndex];
+		if (coverObject && coverObject->CoverPoints.IsValidIndex(localIndex) && !coverObject->CoverPoints[localIndex].Enabled)
+		{
+			continue;
+		}
+		if (!IsVisible(point, coverPoint))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void ACoverLevelData::InvalidateBakedCoverObject(const AActor* coverObject)
+{
+	//Only the lookup is dropped, the other cover objects keep their indices into the matrix
+	if (coverObject)
+	{
+		BakedIndices.Remove(FSoftObjectPath(coverObject));
+	}
+}
+
+bool ACoverLevelData::AreCoversVisible(const FCoverPointRef& coverA, const FCoverPointRef& coverB) const
+{
+	int32 coverPointA = GetCoverPointIndex(coverA);
+	int32 coverPointB = GetCoverPointIndex(coverB);
+	if (coverPointA == INDEX_NONE || coverPointB == INDEX_NONE)
+	{
+		return true;
+	}
+	return IsVisible(coverPointA, coverPointB);
+}
+
+// Called when the game starts or when spawned
+void ACoverLevelData::BeginPlay()
+{
+	Super::BeginPlay();
+
+	BakedIndices.Reset();
+	//Covers in sublevels that are not loaded yet are found by path when they register
+	for (int32 i = 0; i < BakedCoverObjects.Num(); i++)
+	{
+		if (!BakedCoverObjects[i].IsNull())
+		{
+			BakedIndices.Add(BakedCoverObjects[i].ToSoftObjectPath(), i);
+		}
+	}
+
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->SetCoverLevelData(this);
+	}
+}
+
+void ACoverLevelData::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director && director->CoverLevelData == this)
+	{
+		director->SetCoverLevelData(nullptr);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "CoverObject.h"
+#include "CoverLevelData.generated.h"
+
+//Placed once in the persistent level to hold cover data that is too expensive to work out at runtime. Bake it from the details panel with every sublevel loaded whenever the cover in any of them changes
+UCLASS()
+class GUNSLINGERS_API ACoverLevelData : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	ACoverLevelData();
+
+	//Height above each cover point that visibility is traced from, around the eye height of a crouched character
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Bake")
+	float TraceHeight = 60.f;
+
+	//Every cover object that was loaded when it was baked. Soft references, so level data in the persistent level does not keep streamed sublevels' covers loaded and looks them up by path as they stream in
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Bake")
+	TArray<TSoftObjectPtr<class ACoverObject>> BakedCoverObjects;
+
+	//Index of the first cover point of each baked cover object, its points follow in the same order as its CoverPoints
+	UPROPERTY(VisibleAnywhere, Category = "Bake")
+	TArray<int32> FirstCoverPoints;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Bake")
+	int32 NumCoverPoints = 0;
+
+	//Upper triangle of the cover point visibility matrix (it is symmetric), one bit per pair packed 32 to a word
+	UPROPERTY()
+	TArray<uint32> VisibilityBits;
+
+	//Bakes the cover points of every cover object in the level into the level, then their visibility since it depends on them
+	UFUNCTION(CallInEditor, Category = "Bake")
+	void BakeCoverPoints();
+
+	//Traces between every pair of cover points in the level and stores which can see each other. Cover objects that have not had their points baked are baked first
+	UFUNCTION(CallInEditor, Category = "Bake")
+	void BakeVisibility();
+
+	//Whether two cover points could see each other when baked, a point can always see itself
+	bool IsVisible(int32 coverPointA, int32 coverPointB) const;
+
+	//Returns the index a cover object was baked at, or INDEX_NONE if it was added after the bake
+	int32 GetBakedIndex(const AActor* coverObject) const;
+
+	//Returns the baked cover point of one of a cover object's cover points, or INDEX_NONE if it is not baked
+	int32 GetCoverPointIndex(const FCoverPointRef& cover) const;
+
+	//True if every enabled cover point of the baked cover object can see coverPoint, i.e. there is no side of it to hide behind
+	bool IsCoverObjectExposedTo(int32 bakedIndex, int32 coverPoint) const;
+
+	//Stops using the baked visibility of a cover object that has moved since the bake, from then on it is treated as if it was added after the bake
+	void InvalidateBakedCoverObject(const AActor* coverObject);
+
+	//Whether two cover points could see each other when baked. Cover points that were not baked count as visible
+	UFUNCTION(BlueprintPure, Category = "Bake")
+	bool AreCoversVisible(const FCoverPointRef& coverA, const FCoverPointRef& coverB) const;
+
+protected:
+	//Looks up the baked index of a cover object by its path without a search or loading anything, built on BeginPlay
+	TMap<FSoftObjectPath, int32> BakedIndices;
+
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+
+	// Called when removed from the world, unhooks from the AI director
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+};
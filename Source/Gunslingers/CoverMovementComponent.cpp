@@ -0,0 +1,167 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverMovementComponent.h"
+#include "Components/CapsuleComponent.h"
+#include "GameFramework/Character.h"
+
+bool UCoverMovementComponent::EnterCover(const FCoverPointRef& cover)
+{
+	const FCoverPoint* coverPoint = cover.Get();
+	if (coverPoint == nullptr || UpdatedComponent == nullptr)
+	{
+		return false;
+	}
+
+	//The cover point faces the centre of the cover mesh, so its forward is into the cover and its side runs along the edge
+	const FQuat rotation = coverPoint->Rotation.Quaternion();
+	EdgeNormal = rotation.GetAxisX().GetSafeNormal2D();
+	EdgeAxis = rotation.GetAxisY().GetSafeNormal2D();
+	//The point is only CoverRange off the face of the cover, the line the capsule moves along is a radius off it so the capsule can reach it without pushing into the mesh
+	const float radius = CharacterOwner ? CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleRadius() : 0.f;
+	const float coverRange = cover.CoverObject ? cover.CoverObject->CoverRange : 0.f;
+	EdgeCenter = coverPoint->Location - EdgeNormal * FMath::Max(radius - coverRange, 0.f);
+	//Keep the whole capsule within the edge so the character does not stick out past the end of the cover
+	EdgeHalfLength = FMath::Max(coverPoint->Extent.Y - radius, 0.f);
+	CoverObject = cover.CoverObject;
+	CoverIndex = cover.Index;
+
+	const FVector location = UpdatedComponent->GetComponentLocation();
+	const float along = FMath::Clamp((location - EdgeCenter) | EdgeAxis, -EdgeHalfLength, EdgeHalfLength);
+	SnapTarget = EdgeCenter + EdgeAxis * along;
+	SnapTarget.Z = location.Z;
+	SnapBlockedTime = 0.f;
+
+	SetMovementMode(MOVE_Custom, CoverSnap);
+	return true;
+}
+
+void UCoverMovementComponent::ExitCover()
+{
+	if (IsInCoverMovement())
+	{
+		SetMovementMode(MOVE_Walking);
+	}
+}
+
+bool UCoverMovementComponent::IsInCoverMovement() const
+{
+	return MovementMode == MOVE_Custom && (CustomMovementMode == CoverSnap || CustomMovementMode == CoverSlide);
+}
+
+bool UCoverMovementComponent::IsMovingOnGround() const
+{
+	//Cover is always on the ground, which lets crouching carry on as it would when walking
+	return Super::IsMovingOnGround() || IsInCoverMovement();
+}
+
+float UCoverMovementComponent::GetMaxSpeed() const
+{
+	if (IsInCoverMovement())
+	{
+		return IsCrouching() ? MaxWalkSpeedCrouched : MaxWalkSpeed;
+	}
+	return Super::GetMaxSpeed();
+}
+
+void UCoverMovementComponent::OnMovementModeChanged(EMovementMode PreviousMovementMode, uint8 PreviousCustomMode)
+{
+	Super::OnMovementModeChanged(PreviousMovementMode, PreviousCustomMode);
+
+	if (!IsInCoverMovement())
+	{
+		CoverObject.Reset();
+		CoverIndex = INDEX_NONE;
+	}
+}
+
+void UCoverMovementComponent::PhysCustom(float deltaTime, int32 Iterations)
+{
+	if (!IsInCoverMovement())
+	{
+		Super::PhysCustom(deltaTime, Iterations);
+		return;
+	}
+	if (deltaTime < MIN_TICK_TIME)
+	{
+		return;
+	}
+	//The cover has gone or its side has been shot apart, carry on walking from here
+	if (!FCoverPointRef(CoverObject.Get(), CoverIndex).IsValid())
+	{
+		SetMovementMode(MOVE_Walking);
+		StartNewPhysics(deltaTime, Iterations);
+		return;
+	}
+
+	const FVector location = UpdatedComponent->GetComponentLocation();
+	FVector delta = FVector::ZeroVector;
+	bool arrived = false;
+
+	if (CustomMovementMode == CoverSnap)
+	{
+		FVector toTarget = SnapTarget - location;
+		toTarget.Z = 0.f;
+		const float distance = toTarget.Size();
+		const float step = CoverSnapSpeed * deltaTime;
+		if (distance <= step)
+		{
+			delta = toTarget;
+			arrived = true;
+		}
+		else
+		{
+			delta = toTarget * (step / distance);
+		}
+	}
+	else
+	{
+		//Pushing away from the cover steps out of it
+		const FVector inputDirection = Acceleration.GetSafeNormal2D();
+		if ((inputDirection | EdgeNormal) < -CoverExitInputThreshold)
+		{
+			SetMovementMode(MOVE_Walking);
+			StartNewPhysics(deltaTime, Iterations);
+			return;
+		}
+
+		//Only the part of the input along the edge moves the character, and never past either end
+		const FVector offset = location - EdgeCenter;
+		const float along = offset | EdgeAxis;
+		const float inputAlong = (Acceleration | EdgeAxis) / FMath::Max(GetMaxAcceleration(), KINDA_SMALL_NUMBER);
+		const float newAlong = FMath::Clamp(along + inputAlong * GetMaxSpeed() * deltaTime, -EdgeHalfLength, EdgeHalfLength);
+		//Pulled back onto the edge if anything pushed it off
+		const float away = offset | EdgeNormal;
+		const float correction = FMath::Clamp(-away, -CoverSnapSpeed * deltaTime, CoverSnapSpeed * deltaTime);
+		delta = EdgeAxis * (newAlong - along) + EdgeNormal * correction;
+	}
+
+	Velocity = delta / deltaTime;
+
+	FHitResult hit(1.f);
+	SafeMoveUpdatedComponent(delta, UpdatedComponent->GetComponentQuat(), true, hit);
+	if (hit.IsValidBlockingHit())
+	{
+		SlideAlongSurface(delta, 1.f - hit.Time, hit.Normal, hit, true);
+	}
+
+	//Cover is never taken mid air, so losing the floor means falling out of it
+	FindFloor(UpdatedComponent->GetComponentLocation(), CurrentFloor, false);
+	if (!CurrentFloor.IsWalkableFloor())
+	{
+		SetMovementMode(MOVE_Falling);
+		return;
+	}
+	AdjustFloorHeight();
+
+	if (CustomMovementMode == CoverSnap)
+	{
+		//Something between the character and the edge, slide from wherever it got to rather than push forever
+		const float moved = FVector::Dist2D(location, UpdatedComponent->GetComponentLocation());
+		SnapBlockedTime = moved < 0.1f * delta.Size() ? SnapBlockedTime + deltaTime : 0.f;
+		if (arrived || SnapBlockedTime >= CoverSnapMaxBlockedTime)
+		{
+			SetMovementMode(MOVE_Custom, CoverSlide);
+		}
+	}
+}
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "CoverObject.h"
+#include "CoverMovementComponent.generated.h"
+
+//Custom movement modes used under MOVE_Custom
+UENUM(BlueprintType)
+enum CoverMovementModes
+{
+	//Moving straight onto the cover's edge
+	CoverSnap UMETA(DisplayName = "Cover Snap"),
+	//On the edge, input only slides along it
+	CoverSlide UMETA(DisplayName = "Cover Slide")
+};
+
+//Character movement that can take the character into cover without the pathfinder. The edge of a cover is the long side of its cover point's box, worked out once on entering, so moving in cover is only a projection onto it
+UCLASS()
+class GUNSLINGERS_API UCoverMovementComponent : public UCharacterMovementComponent
+{
+	GENERATED_BODY()
+
+public:
+	//Starts moving onto the nearest point of the cover's edge and then sliding along it. Returns false if the cover point is not valid
+	UFUNCTION(BlueprintCallable, Category = "Cover")
+	bool EnterCover(const FCoverPointRef& cover);
+
+	//Goes back to walking if in cover
+	UFUNCTION(BlueprintCallable, Category = "Cover")
+	void ExitCover();
+
+	//Whether the character is moving onto or along a cover. Anything else taking over the movement, like jumping or falling off a ledge, ends it
+	UFUNCTION(BlueprintPure, Category = "Cover")
+	bool IsInCoverMovement() const;
+
+	//How fast the character moves onto the edge
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Cover")
+	float CoverSnapSpeed = 600.f;
+
+	//How much of the input has to point away from the cover to step out of it
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Cover")
+	float CoverExitInputThreshold = 0.7f;
+
+	//Gives up snapping when blocked for this long, the character slides from wherever it got to
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Cover")
+	float CoverSnapMaxBlockedTime = 0.25f;
+
+	virtual bool IsMovingOnGround() const override;
+	virtual float GetMaxSpeed() const override;
+
+protected:
+	virtual void PhysCustom(float deltaTime, int32 Iterations) override;
+
+	virtual void OnMovementModeChanged(EMovementMode PreviousMovementMode, uint8 PreviousCustomMode) override;
+
+private:
+	TWeakObjectPtr<ACoverObject> CoverObject;
+	int32 CoverIndex = INDEX_NONE;
+
+	//The edge runs along EdgeAxis for EdgeHalfLength either side of EdgeCenter, EdgeNormal points from the edge into the cover
+	FVector EdgeCenter = FVector::ZeroVector;
+	FVector EdgeAxis = FVector::ZeroVector;
+	FVector EdgeNormal = FVector::ZeroVector;
+	float EdgeHalfLength = 0.f;
+
+	//Where on the edge the snap is heading for
+	FVector SnapTarget = FVector::ZeroVector;
+	float SnapBlockedTime = 0.f;
+};
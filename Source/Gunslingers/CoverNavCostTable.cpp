@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverNavCostTable.h"
+#include "Algo/BinarySearch.h"
+
+constexpr float FCoverNavCostRow::Unreachable;
+
+float FCoverNavCostRow::GetCost(int32 id) const
+{
+	int32 index = Algo::BinarySearch(Ids, id);
+	return index != INDEX_NONE ? Costs[index] : -1.f;
+}
+
+void FCoverNavCostTable::Reset()
+{
+	Rows.Reset();
+	Generations.Reset();
+	DirtyRows.Reset();
+	DirtyHead = 0;
+	IsDirty.Empty();
+	NumRows = 0;
+}
+
+void FCoverNavCostTable::Grow(int32 id)
+{
+	if (id >= Rows.Num())
+	{
+		const int32 numToAdd = id + 1 - Rows.Num();
+		Rows.AddDefaulted(numToAdd);
+		Generations.AddZeroed(numToAdd);
+		IsDirty.Add(false, numToAdd);
+	}
+}
+
+TSharedPtr<const FCoverNavCostRow, ESPMode::ThreadSafe> FCoverNavCostTable::GetRow(int32 id) const
+{
+	return Rows.IsValidIndex(id) ? Rows[id] : nullptr;
+}
+
+float FCoverNavCostTable::GetCost(int32 fromId, int32 toId) const
+{
+	if (!Rows.IsValidIndex(fromId) || !Rows[fromId].IsValid())
+	{
+		return -1.f;
+	}
+	return Rows[fromId]->GetCost(toId);
+}
+
+void FCoverNavCostTable::MarkDirty(int32 id)
+{
+	if (id == INDEX_NONE)
+	{
+		return;
+	}
+	Grow(id);
+	Generations[id]++;
+	if (!IsDirty[id])
+	{
+		IsDirty[id] = true;
+		DirtyRows.Add(id);
+	}
+}
+
+void FCoverNavCostTable::RemoveRow(int32 id)
+{
+	if (!Rows.IsValidIndex(id))
+	{
+		return;
+	}
+	if (Rows[id].IsValid())
+	{
+		NumRows--;
+	}
+	Rows[id].Reset();
+	Generations[id]++;
+	//Left in the queue, PopDirty skips rows whose bit is clear
+	IsDirty[id] = false;
+}
+
+int32 FCoverNavCostTable::PopDirty()
+{
+	//Oldest first, reading from a head index so popping never shifts the queue
+	while (DirtyHead < DirtyRows.Num())
+	{
+		int32 id = DirtyRows[DirtyHead++];
+		if (IsDirty[id])
+		{
+			IsDirty[id] = false;
+			return id;
+		}
+	}
+	DirtyRows.Reset();
+	DirtyHead = 0;
+	return INDEX_NONE;
+}
+
+void FCoverNavCostTable::SetRow(int32 id, int32 generation, TSharedRef<const FCoverNavCostRow, ESPMode::ThreadSafe> row)
+{
+	if (!Rows.IsValidIndex(id) || Generations[id] != generation)
+	{
+		return;
+	}
+	if (!Rows[id].IsValid())
+	{
+		NumRows++;
+	}
+	Rows[id] = row;
+}
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Path costs from one cover to every cover within range of it, sorted by id so a lookup is a binary search. Rows are never changed once built, a refreshed row replaces the old one, so they can be shared with worker threads
+struct GUNSLINGERS_API FCoverNavCostRow
+{
+	TArray<int32> Ids;
+	TArray<float> Costs;
+
+	//Cost stored for covers that can't be reached
+	static constexpr float Unreachable = MAX_flt;
+
+	//Returns the path cost to the cover, or a negative number if it is not in the row
+	float GetCost(int32 id) const;
+};
+
+//Cover-to-cover navigation cost table, indexed by the same stable ids as the AI director. Tracks which rows are out of date so they can be rebuilt a few at a time
+struct GUNSLINGERS_API FCoverNavCostTable
+{
+public:
+	void Reset();
+
+	//Returns the row for a cover, or nullptr if it has not been built
+	TSharedPtr<const FCoverNavCostRow, ESPMode::ThreadSafe> GetRow(int32 id) const;
+
+	//Path cost between two covers, or a negative number if it is not known
+	float GetCost(int32 fromId, int32 toId) const;
+
+	//Queues a row to be rebuilt, any build of it already in progress is now stale
+	void MarkDirty(int32 id);
+
+	//Drops a row, used when its cover is unregistered
+	void RemoveRow(int32 id);
+
+	//Takes the next row to rebuild off the queue, returns INDEX_NONE if there are none
+	int32 PopDirty();
+
+	bool HasDirty() const { return DirtyHead < DirtyRows.Num(); }
+
+	//Bumped every time a row is marked dirty or removed, a finished build is only kept if it still matches
+	int32 GetGeneration(int32 id) const { return Generations.IsValidIndex(id) ? Generations[id] : 0; }
+
+	//Stores a finished row if generation is still current
+	void SetRow(int32 id, int32 generation, TSharedRef<const FCoverNavCostRow, ESPMode::ThreadSafe> row);
+
+	int32 NumBuiltRows() const { return NumRows; }
+
+private:
+	void Grow(int32 id);
+
+	TArray<TSharedPtr<const FCoverNavCostRow, ESPMode::ThreadSafe>> Rows;
+	TArray<int32> Generations;
+
+	//Queue of rows to rebuild, the bit array stops a row being queued twice
+	TArray<int32> DirtyRows;
+	int32 DirtyHead = 0;
+	TBitArray<> IsDirty;
+
+	int32 NumRows = 0;
+};
@@ -2,10 +2,166 @@
 
 
 #include "CoverObject.h"
+#include "AIDirector.h"
 #include "Cover.h"
+#include "GunslingersCharacter.h"
+#include "GameFramework/PlayerController.h"
 #include "Components/StaticMeshComponent.h"
-#include "Components/BoxComponent.h"
+#include "Engine/StaticMesh.h"
+#include "PhysicsEngine/BodySetup.h"
 #include "Kismet/GameplayStatics.h"
+#include "Engine/World.h"
+#include "TimerManager.h"
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	//Points around a sphere or the end of a capsule, enough to find the sides of the hull they make
+	const int32 NumRoundSamples = 16;
+
+	//Exposure is traced from around the eye height of a crouched character, out to about the width of a cover mesh
+	const float ExposureTraceHeight = 60.f;
+	const float ExposureTraceDistance = 300.f;
+	const int32 ExposureRaysPerSector = 4;
+	const int32 ExposureRaysPerPoint = FCoverPoint::NumExposureSectors * ExposureRaysPerSector;
+
+	//Where one of a point's exposure rays goes, spread evenly through each sector the same way round as GetExposureSector
+	void GetExposureRay(const FCoverPoint& point, int32 pointRay, FVector& outStart, FVector& outEnd)
+	{
+		const float angle = (pointRay + 0.5f) * 2.f * PI / ExposureRaysPerPoint - PI;
+		const FVector direction = point.Rotation.RotateVector(FVector(FMath::Cos(angle), FMath::Sin(angle), 0.f));
+		outStart = point.Location + FVector(0.f, 0.f, ExposureTraceHeight);
+		outEnd = outStart + direction * ExposureTraceDistance;
+	}
+
+	//Fills in a point's exposure from whether each of its rays hit something
+	void SetExposureFromRays(FCoverPoint& point, const bool* blocked)
+	{
+		point.Exposure.SetNumZeroed(FCoverPoint::NumExposureSectors);
+		for (int32 sector = 0; sector < FCoverPoint::NumExposureSectors; sector++)
+		{
+			int32 open = 0;
+			for (int32 r = 0; r < ExposureRaysPerSector; r++)
+			{
+				open += blocked[sector * ExposureRaysPerSector + r] ? 0 : 1;
+			}
+			point.Exposure[sector] = (uint8)(255 * open / ExposureRaysPerSector);
+		}
+	}
+
+	void AddRoundPoints(const FTransform& transform, const FVector& center, float radius, TArray<FVector>& outPoints)
+	{
+		for (int32 i = 0; i < NumRoundSamples; i++)
+		{
+			const float angle = 2.f * PI * i / NumRoundSamples;
+			outPoints.Add(transform.TransformPosition(center + FVector(FMath::Cos(angle) * radius, FMath::Sin(angle) * radius, 0.f)));
+		}
+		outPoints.Add(transform.TransformPosition(center + FVector(0.f, 0.f, radius)));
+		outPoints.Add(transform.TransformPosition(center - FVector(0.f, 0.f, radius)));
+	}
+
+	//Samples every shape of the mesh's simple collision into points in the mesh's space with the given scale
+	void GatherCollisionPoints(const UStaticMesh* staticMesh, const FVector& scale, TArray<FVector>& outPoints)
+	{
+		const UBodySetup* bodySetup = staticMesh ? staticMesh->BodySetup : nullptr;
+		if (bodySetup == nullptr)
+		{
+			return;
+		}
+
+		const FKAggregateGeom& geometry = bodySetup->AggGeom;
+		TArray<FVector> elementPoints;
+		for (const FKConvexElem& convex : geometry.ConvexElems)
+		{
+			const FTransform transform = convex.GetTransform();
+			for (const FVector& vertex : convex.VertexData)
+			{
+				elementPoints.Add(transform.TransformPosition(vertex));
+			}
+		}
+		for (const FKBoxElem& box : geometry.BoxElems)
+		{
+			const FTransform transform = box.GetTransform();
+			for (int32 corner = 0; corner < 8; corner++)
+			{
+				elementPoints.Add(transform.TransformPosition(0.5f * FVector(corner & 1 ? box.X : -box.X, corner & 2 ? box.Y : -box.Y, corner & 4 ? box.Z : -box.Z)));
+			}
+		}
+		for (const FKSphereElem& sphere : geometry.SphereElems)
+		{
+			AddRoundPoints(FTransform::Identity, sphere.Center, sphere.Radius, elementPoints);
+		}
+		for (const FKSphylElem& sphyl : geometry.SphylElems)
+		{
+			const FTransform transform = sphyl.GetTransform();
+			AddRoundPoints(transform, FVector(0.f, 0.f, 0.5f * sphyl.Length), sphyl.Radius, elementPoints);
+			AddRoundPoints(transform, FVector(0.f, 0.f, -0.5f * sphyl.Length), sphyl.Radius, elementPoints);
+		}
+
+		outPoints.Reserve(outPoints.Num() + elementPoints.Num());
+		for (const FVector& point : elementPoints)
+		{
+			outPoints.Add(point * scale);
+		}
+	}
+
+	//Anticlockwise convex hull with no collinear points, by the monotone chain method
+	void ComputeConvexHull2D(TArray<FVector2D> points, TArray<FVector2D>& outHull)
+	{
+		outHull.Reset();
+		points.Sort([](const FVector2D& a, const FVector2D& b) { return a.X < b.X || (a.X == b.X && a.Y < b.Y); });
+		if (points.Num() < 3)
+		{
+			outHull = points;
+			return;
+		}
+
+		const auto cross = [](const FVector2D& o, const FVector2D& a, const FVector2D& b) { return FVector2D::CrossProduct(a - o, b - o); };
+		outHull.SetNum(2 * points.Num());
+		int32 num = 0;
+		//Lower half then upper half, dropping any point that does not turn left
+		for (int32 i = 0; i < points.Num(); i++)
+		{
+			while (num >= 2 && cross(outHull[num - 2], outHull[num - 1], points[i]) <= 0.f)
+			{
+				num--;
+			}
+			outHull[num++] = points[i];
+		}
+		const int32 lowerNum = num + 1;
+		for (int32 i = points.Num() - 2; i >= 0; i--)
+		{
+			while (num >= lowerNum && cross(outHull[num - 2], outHull[num - 1], points[i]) <= 0.f)
+			{
+				num--;
+			}
+			outHull[num++] = points[i];
+		}
+		//The last point is the first one again
+		outHull.SetNum(num - 1);
+	}
+}
+
+const FCoverPoint* FCoverPointRef::Get() const
+{
+	return CoverObject && !CoverObject->IsPendingKill() && CoverObject->CoverPoints.IsValidIndex(Index) && CoverObject->CoverPoints[Index].Enabled ? &CoverObject->CoverPoints[Index] : nullptr;
+}
+
+int32 FCoverPoint::GetExposureSector(const FVector& direction)
+{
+	const float angle = FMath::Atan2(direction.Y, direction.X) + PI;
+	return FMath::Clamp(FMath::FloorToInt(angle * NumExposureSectors / (2.f * PI)), 0, NumExposureSectors - 1);
+}
+
+float FCoverPoint::GetExposure(const FVector& direction) const
+{
+	//Not traced yet, nothing is known to be in the way
+	if (Exposure.Num() != NumExposureSectors)
+	{
+		return 1.f;
+	}
+	return Exposure[GetExposureSector(Rotation.UnrotateVector(direction))] / 255.f;
+}
 
 // Sets default values
 ACoverObject::ACoverObject()
@@ -24,17 +180,60 @@ ACoverObject::ACoverObject()
 
 //Returns the furthest cover from the player (Determines which side of cover is opposite to the player)
 AActor * ACoverObject::GetFurthestCoverToPlayer()
+{
+	int32 coverPoint = GetFurthestCoverPointToPlayer();
+	if (coverPoint == INDEX_NONE)
+	{
+		return nullptr;
+	}
+
+	//One marker per cover object, moved onto whichever side is furthest each time it is asked for
+	if (FurthestCoverMarker == nullptr || FurthestCoverMarker->IsPendingKill())
+	{
+		FActorSpawnParameters spawnParams;
+		spawnParams.Owner = this;
+		spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		spawnParams.ObjectFlags |= RF_Transient;
+		FurthestCoverMarker = GetWorld()->SpawnActor<ACover>(ACover::StaticClass(), spawnParams);
+	}
+	if (FurthestCoverMarker)
+	{
+		FurthestCoverMarker->SetActorLocationAndRotation(CoverPoints[coverPoint].Location, CoverPoints[coverPoint].Rotation);
+	}
+	return FurthestCoverMarker;
+}
+
+//Returns where the furthest cover from the player is
+FVector ACoverObject::GetFurthestCoverLocationToPlayer()
+{
+	int32 coverPoint = GetFurthestCoverPointToPlayer();
+	return coverPoint != INDEX_NONE ? CoverPoints[coverPoint].Location : GetActorLocation();
+}
+
+int32 ACoverObject::GetFurthestCoverPointToPlayer()
 {	
-	FVector playerLoc = GetWorld()->GetFirstPlayerController()->GetPawn()->GetActorLocation();
-	FVector coverLoc = MyCovers[0]->GetActorLocation();
+	//With co-op the side that matters is the one away from the closest player
+	AAIDirector* director = AAIDirector::Get(this);
+	APawn* player = director ? director->GetNearestThreat(GetActorLocation()) : nullptr;
+	FVector playerLoc = player ? player->GetActorLocation() : FVector::ZeroVector;
+	FVector coverLoc;
 
-	int currentWinner = 0;
-	float currentLargestDistance = (coverLoc - playerLoc).SizeSquared();
+	int currentWinner = INDEX_NONE;
+	float currentLargestDistance = -1.f;
 	float tmpDistance;
 
-	for (int i = 1; i < MyCovers.Num(); i++)
+	for (int i = 0; i < CoverPoints.Num(); i++)
 	{
-		coverLoc = MyCovers[i]->GetActorLocation();
+		//Sides that have been disabled are not there to hide behind
+		if (!CoverPoints[i].Enabled)
+		{
+			continue;
+		}
+		if (player == nullptr)
+		{
+			return i;
+		}
+		coverLoc = CoverPoints[i].Location;
 		tmpDistance = (coverLoc - playerLoc).SizeSquared();
 		if (tmpDistance > currentLargestDistance)
 		{
@@ -42,8 +241,341 @@ AActor * ACoverObject::GetFurthestCoverToPlayer()
 			currentWinner = i;
 		}
 	}
-	return MyCovers[currentWinner];
+	return currentWinner;
+
+}
+
+void ACoverObject::CalculateCoverPoints(TArray<FCoverPoint>& outPoints) const
+{
+	CalculateMeshCoverPoints(CoverMesh->GetStaticMesh(), CoverMesh->GetComponentTransform(), CoverRange, LowCoverMaxHeight, CoverEdgeMergeAngle, MinCoverEdgeLength, outPoints);
+}
+
+void ACoverObject::CalculateMeshCoverPoints(const UStaticMesh* mesh, const FTransform& transform, float coverRange, float lowCoverMaxHeight, float coverEdgeMergeAngle, float minCoverEdgeLength, TArray<FCoverPoint>& outPoints)
+{
+	if (mesh == nullptr)
+	{
+		return;
+	}
+
+	//Points of the collision in the mesh's space with its scale, the cover points are placed around them and then moved with the mesh
+	TArray<FVector> collisionPoints;
+	GatherCollisionPoints(mesh, transform.GetScale3D(), collisionPoints);
+	if (collisionPoints.Num() == 0)
+	{
+		//No collision to sample, use the corners of the mesh bounds
+		const FBox meshBox = mesh->GetBounds().GetBox();
+		for (int32 corner = 0; corner < 8; corner++)
+		{
+			collisionPoints.Add(transform.GetScale3D() * FVector(corner & 1 ? meshBox.Max.X : meshBox.Min.X, corner & 2 ? meshBox.Max.Y : meshBox.Min.Y, corner & 4 ? meshBox.Max.Z : meshBox.Min.Z));
+		}
+	}
+
+	float minZ = MAX_flt;
+	float maxZ = -MAX_flt;
+	TArray<FVector2D> points2D;
+	points2D.Reserve(collisionPoints.Num());
+	for (const FVector& point : collisionPoints)
+	{
+		minZ = FMath::Min(minZ, point.Z);
+		maxZ = FMath::Max(maxZ, point.Z);
+		points2D.Add(FVector2D(point));
+	}
+	TArray<FVector2D> hull;
+	ComputeConvexHull2D(points2D, hull);
+	if (hull.Num() < 3)
+	{
+		return;
+	}
+
+	//Every side of the mesh is as tall as the mesh
+	const float height = maxZ - minZ;
+	TEnumAsByte<CoverHeights> heightClass = height <= lowCoverMaxHeight ? CoverHeights::LowCover : CoverHeights::HighCover;
+	const FVector meshLoc = transform.GetLocation();
+	const FQuat meshRot = transform.GetRotation();
+	const float mergeCos = FMath::Cos(FMath::DegreesToRadians(coverEdgeMergeAngle));
+
+	//Start on a sharp corner so a run of merged sides never wraps around the start of the hull
+	const int32 numHull = hull.Num();
+	int32 start = 0;
+	float sharpest = MAX_flt;
+	for (int32 i = 0; i < numHull; i++)
+	{
+		const FVector2D before = (hull[i] - hull[(i + numHull - 1) % numHull]).GetSafeNormal();
+		const FVector2D after = (hull[(i + 1) % numHull] - hull[i]).GetSafeNormal();
+		const float turn = FVector2D::DotProduct(before, after);
+		if (turn < sharpest)
+		{
+			sharpest = turn;
+			start = i;
+		}
+	}
+
+	int32 i = 0;
+	while (i < numHull)
+	{
+		//Grow the side while the hull keeps heading the same way
+		const FVector2D sideStart = hull[(start + i) % numHull];
+		FVector2D sideEnd = hull[(start + i + 1) % numHull];
+		const FVector2D direction = (sideEnd - sideStart).GetSafeNormal();
+		i++;
+		while (i < numHull)
+		{
+			const FVector2D next = hull[(start + i + 1) % numHull];
+			if (FVector2D::DotProduct((next - sideEnd).GetSafeNormal(), direction) < mergeCos)
+			{
+				break;
+			}
+			sideEnd = next;
+			i++;
+		}
+
+		const float length = (sideEnd - sideStart).Size();
+		if (length < minCoverEdgeLength)
+		{
+			continue;
+		}
+
+		//The hull goes anticlockwise, so the outside of each side is to its right. Stick out from the middle of the side by the amount in the coverrange variable
+		const FVector2D side = (sideEnd - sideStart) / length;
+		const FVector outward(side.Y, -side.X, 0.f);
+		const FVector2D middle = 0.5f * (sideStart + sideEnd);
+		FVector offset = FVector(middle.X, middle.Y, 0.f) + outward * coverRange;
+		FCoverPoint point;
+		point.Location = meshLoc + meshRot.RotateVector(offset);
+		//Always facing towards the side of the cover mesh
+		point.Rotation = (meshRot * FRotationMatrix::MakeFromX(-outward).ToQuat()).Rotator();
+		//Match the side and stick out by the amount in the coverrange variable
+		point.Extent = FVector(coverRange, 0.5f * length, 0.5f * height);
+		point.Height = heightClass;
+		outPoints.Add(point);
+	}
+}
+
+void ACoverObject::CalculateExposure(const UWorld* world, TArray<FCoverPoint>& points)
+{
+	if (world == nullptr)
+	{
+		return;
+	}
+	TArray<int32> pending;
+	for (int32 i = 0; i < points.Num(); i++)
+	{
+		if (points[i].Exposure.Num() != FCoverPoint::NumExposureSectors)
+		{
+			pending.Add(i);
+		}
+	}
+
+	static const FName TraceTag(TEXT("CoverExposure"));
+	const FCollisionQueryParams params(TraceTag, false);
+	FCollisionObjectQueryParams objectParams;
+	objectParams.AddObjectTypesToQuery(ECC_WorldStatic);
+	objectParams.AddObjectTypesToQuery(ECC_WorldDynamic);
+
+	//Every ray of every point is one item, each writes only its own result so no locking is needed
+	TArray<bool> blocked;
+	blocked.SetNumZeroed(pending.Num() * ExposureRaysPerPoint);
+	ParallelFor(blocked.Num(), [&](int32 ray)
+	{
+		FVector start, end;
+		GetExposureRay(points[pending[ray / ExposureRaysPerPoint]], ray % ExposureRaysPerPoint, start, end);
+		blocked[ray] = world->LineTraceTestByObjectType(start, end, objectParams, params);
+	});
+
+	for (int32 p = 0; p < pending.Num(); p++)
+	{
+		SetExposureFromRays(points[pending[p]], blocked.GetData() + p * ExposureRaysPerPoint);
+	}
+}
+
+void ACoverObject::StartExposureTraces()
+{
+	UWorld* world = GetWorld();
+	ExposureTraces.Reset();
+	ExposureTracePoints.Reset();
+	if (world == nullptr)
+	{
+		return;
+	}
+
+	static const FName TraceTag(TEXT("CoverExposure"));
+	const FCollisionQueryParams params(TraceTag, false);
+	FCollisionObjectQueryParams objectParams;
+	objectParams.AddObjectTypesToQuery(ECC_WorldStatic);
+	objectParams.AddObjectTypesToQuery(ECC_WorldDynamic);
+
+	for (int32 i = 0; i < CoverPoints.Num(); i++)
+	{
+		if (CoverPoints[i].Exposure.Num() == FCoverPoint::NumExposureSectors)
+		{
+			continue;
+		}
+		ExposureTracePoints.Add(i);
+		for (int32 ray = 0; ray < ExposureRaysPerPoint; ray++)
+		{
+			FVector start, end;
+			GetExposureRay(CoverPoints[i], ray, start, end);
+			ExposureTraces.Add(world->AsyncLineTraceByObjectType(EAsyncTraceType::Single, start, end, objectParams, params));
+		}
+	}
+	if (ExposureTraces.Num() > 0)
+	{
+		world->GetTimerManager().SetTimerForNextTick(this, &ACoverObject::CollectExposureTraces);
+	}
+}
+
+void ACoverObject::CollectExposureTraces()
+{
+	UWorld* world = GetWorld();
+	if (world == nullptr || ExposureTraces.Num() == 0)
+	{
+		return;
+	}
 
+	//Results are only kept for the frame after they are queued, so every trace is read back the first time they are all there
+	FTraceDatum datum;
+	for (const FTraceHandle& trace : ExposureTraces)
+	{
+		if (world->IsTraceHandleValid(trace, false) && !world->QueryTraceData(trace, datum))
+		{
+			world->GetTimerManager().SetTimerForNextTick(this, &ACoverObject::CollectExposureTraces);
+			return;
+		}
+	}
+
+	TArray<bool> blocked;
+	blocked.SetNumZeroed(ExposureTraces.Num());
+	for (int32 i = 0; i < ExposureTraces.Num(); i++)
+	{
+		if (world->QueryTraceData(ExposureTraces[i], datum))
+		{
+			for (const FHitResult& result : datum.OutHits)
+			{
+				blocked[i] = blocked[i] || result.bBlockingHit;
+			}
+		}
+	}
+	for (int32 p = 0; p < ExposureTracePoints.Num(); p++)
+	{
+		//The points may have been worked out again while the traces were in flight, those are traced again later
+		const int32 index = ExposureTracePoints[p];
+		if (CoverPoints.IsValidIndex(index) && CoverPoints[index].Exposure.Num() != FCoverPoint::NumExposureSectors)
+		{
+			SetExposureFromRays(CoverPoints[index], blocked.GetData() + p * ExposureRaysPerPoint);
+		}
+	}
+	ExposureTraces.Reset();
+	ExposureTracePoints.Reset();
+
+	//The director had the points as open all round until now
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->UpdateCoverExposure(this);
+	}
+}
+
+void ACoverObject::BakeCoverPoints()
+{
+	Modify();
+	CoverPoints.Reset();
+	CalculateCoverPoints(CoverPoints);
+	CalculateExposure(GetWorld(), CoverPoints);
+	CoverPointsBaked = true;
+	BakedTransform = GetActorTransform();
+}
+
+void ACoverObject::MoveCover(FTransform newTransform)
+{
+	const FVector previousLocation = GetActorLocation();
+	//The points keep their place relative to the cover, so nothing has to be worked out again
+	const FTransform delta = GetActorTransform().Inverse() * newTransform;
+	SetActorTransform(newTransform);
+	for (FCoverPoint& point : CoverPoints)
+	{
+		point.Location = delta.TransformPosition(point.Location);
+		point.Rotation = (delta.GetRotation() * point.Rotation.Quaternion()).Rotator();
+	}
+
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->UpdateCoverLocation(this, previousLocation);
+	}
+	MarkPlayerGhostsDirty();
+}
+
+void ACoverObject::SetCoverPointEnabled(int32 index, bool enabled)
+{
+	if (!CoverPoints.IsValidIndex(index) || CoverPoints[index].Enabled == enabled)
+	{
+		return;
+	}
+	CoverPoints[index].Enabled = enabled;
+
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->UpdateCoverPoint(this, index);
+	}
+	MarkPlayerGhostsDirty();
+}
+
+void ACoverObject::DestroyCoverPoint(int32 index)
+{
+	SetCoverPointEnabled(index, false);
+	//Unregisters itself from the AI director on EndPlay
+	if (IsCoverDisabled())
+	{
+		Destroy();
+	}
+}
+
+void ACoverObject::MarkPlayerGhostsDirty() const
+{
+	UWorld* world = GetWorld();
+	if (world == nullptr)
+	{
+		return;
+	}
+	for (FConstPlayerControllerIterator it = world->GetPlayerControllerIterator(); it; ++it)
+	{
+		AGunslingersCharacter* player = it->IsValid() ? Cast<AGunslingersCharacter>((*it)->GetPawn()) : nullptr;
+		if (player)
+		{
+			player->MarkGhostDirty();
+		}
+	}
+}
+
+bool ACoverObject::IsCoverDisabled() const
+{
+	for (const FCoverPoint& point : CoverPoints)
+	{
+		if (point.Enabled)
+		{
+			return false;
+		}
+	}
+	return CoverPoints.Num() > 0;
+}
+
+ACoverObject* ACoverObject::SpawnWithCoverPoints(UWorld* world, const FVector& location, const TArray<FCoverPoint>& coverPoints, AActor* owner)
+{
+	//The points are already worked out, so the cover object is spawned as baked and keeps them on BeginPlay, where it registers with the director
+	const FTransform transform(location);
+	ACoverObject* coverObject = world ? world->SpawnActorDeferred<ACoverObject>(ACoverObject::StaticClass(), transform, owner) : nullptr;
+	if (coverObject == nullptr)
+	{
+		return nullptr;
+	}
+	coverObject->CoverPoints = coverPoints;
+	coverObject->CoverPointsBaked = true;
+	coverObject->BakedTransform = transform;
+	coverObject->PrimaryActorTick.bStartWithTickEnabled = false;
+	coverObject->SetActorEnableCollision(false);
+	coverObject->FinishSpawning(transform);
+	return coverObject;
 }
 
 // Called when the game starts or when spawned
@@ -51,64 +583,38 @@ void ACoverObject::BeginPlay()
 {
 	Super::BeginPlay();
 
-	//If there is a valid cover template
-	if (CoverBP)
-	{
-		//Rotation of cover mesh initially
-		FRotator startRot = GetActorRotation();
-		//The cover object is set to zero and the covers are then attached and the whole object rotated back to original rotation. This is to avoid more complex spawning logic
-		SetActorRotation(FRotator::ZeroRotator);
-		//Covers that are spawned are stored in this tmp variable so they can be edited
-		ACover* tmpCover;
-		//Parameters for spawn
-		FActorSpawnParameters SpawnParam;
-
-		//Stores the size of the mesh to be used for spawning location
-		FVector meshSize = CoverMesh->Bounds.GetBox().GetSize();
-		//Stores extent of the mesh to be used for changing cover collision box extent
-		FVector meshExtent = CoverMesh->Bounds.GetBox().GetExtent();
-		//Gets location of the cover mesh
-		FVector actorLoc = GetActorLocation();
-		//The transform for each cover's spawn
-		FTransform SpawnTransform = GetActorTransform();
-		//The attachment rules for each cover which are to keep world location, scale, and rotation
-		FAttachmentTransformRules rules(EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, false);
-		//Set spawn transform scale to one because the location and bounds of each cover will be determined by mesh size and bounds
-		SpawnTransform.SetScale3D(FVector::OneVector);
-
-		//Two for loops for each set of opposite covers (Two on top and bottom, two on left and right of mesh)
-		for (int i = -1; i <= 1; i = i + 2)
-		{
-			//Set location to same Z and Y, but for the X set the  X position + half the mesh size + cover range in either direction; which is what i determines (-1, and 1 )
-			SpawnTransform.SetLocation(FVector(actorLoc.X + (((meshSize.X * i) / 2) + (CoverRange * i))  , actorLoc.Y, actorLoc.Z));
-			//Spawn the coverBP and store it in tmpcover
-			tmpCover = GetWorld()->SpawnActor<ACover>(CoverBP, SpawnTransform, SpawnParam);
-			//Set rotation to always be facing towards center of cover mesh (So the forward can be used to see if actors are moving away or towards the cover; if needed)
-			tmpCover->SetActorRotation((actorLoc - tmpCover->GetActorLocation()).Rotation());
-			//Set cover collision box to match the mesh and stick out by the amount in the coverrange variable
-			tmpCover->CollisionBox->SetBoxExtent(FVector(CoverRange, meshExtent.Y, meshExtent.Z));
-			//Attach to the root of this object
-			tmpCover->AttachToComponent(RootComponent, rules);
-			//Add the cover to the local array of covers
-			MyCovers.Add(tmpCover);
-		}
-		//Same as last for loop but for the Y
-		for (int i = -1; i <= 1; i = i + 2)
-		{
-			SpawnTransform.SetLocation(FVector(actorLoc.X, actorLoc.Y + (((meshSize.Y * i) / 2) + (CoverRange * i)), actorLoc.Z));
-
-			tmpCover = GetWorld()->SpawnActor<ACover>(CoverBP, SpawnTransform, SpawnParam);
-			tmpCover->SetActorRotation((actorLoc - tmpCover->GetActorLocation()).Rotation());
-			tmpCover->CollisionBox->SetBoxExtent(FVector(CoverRange, meshExtent.X, meshExtent.Z));
-			tmpCover->AttachToComponent(RootComponent, rules);
-			MyCovers.Add(tmpCover);
-		}
-
-		//Now all objects are attached and are the right size, rotate the whole object back to original rotation
-		SetActorRotation(startRot);
+	//The cover points are only data, nothing is spawned or added to the physics scene for them. Baked points are loaded with the level, they are only worked out here if the bake is missing or out of date
+	if (!HasCurrentBake())
+	{
+		CoverPoints.Reset();
+		CalculateCoverPoints(CoverPoints);
 	}
+	//Points spawned by the cover generator or for instanced cover come without their exposure. It is traced for any point missing it in the background, so spawning cover stays within the generator's frame budget, and the point counts as open until then
+	StartExposureTraces();
 
-	
+	//Register with the AI director so it can hand this cover out, this also picks up covers in sublevels as they stream in
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->RegisterCover(this);
+	}
+}
+
+void ACoverObject::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->UnregisterCover(this);
+	}
+	MarkPlayerGhostsDirty();
+	if (FurthestCoverMarker && !FurthestCoverMarker->IsPendingKill())
+	{
+		FurthestCoverMarker->Destroy();
+	}
+	FurthestCoverMarker = nullptr;
+
+	Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
@@ -4,8 +4,80 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "WorldCollision.h"
 #include "CoverObject.generated.h"
 
+//Whether a character can shoot over a cover standing up, or has to stay crouched behind it
+UENUM(BlueprintType)
+enum CoverHeights
+{
+	LowCover UMETA(DisplayName = "Low"),
+	HighCover UMETA(DisplayName = "High")
+};
+
+//A place around a cover mesh that a character can take cover at
+USTRUCT(BlueprintType)
+struct FCoverPoint
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Cover")
+	FVector Location = FVector::ZeroVector;
+
+	//Faces towards the centre of the cover mesh
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Cover")
+	FRotator Rotation = FRotator::ZeroRotator;
+
+	//Half size of the area around the point that counts as being in this cover, in the point's own space
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Cover")
+	FVector Extent = FVector::ZeroVector;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Cover")
+	TEnumAsByte<CoverHeights> Height = CoverHeights::LowCover;
+
+	//Disabled points keep their index, so references to them and baked data stay valid, but cannot be taken
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Cover")
+	bool Enabled = true;
+
+	//How exposed the point is to shots from each direction around it, 0 when every ray traced that way hit something and 255 when none did. NumExposureSectors sectors in the point's own space, anticlockwise from straight out of the cover.
+	//Empty until worked out, which counts as fully open so nothing is blocked on a guess
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Cover")
+	TArray<uint8> Exposure;
+
+	static const int32 NumExposureSectors = 16;
+
+	//Sector a direction falls in, by its angle around Z
+	static int32 GetExposureSector(const FVector& direction);
+
+	//How exposed the point is to shots coming from direction in world space, 0 to 1. 1 until the exposure has been traced
+	float GetExposure(const FVector& direction) const;
+};
+
+//One cover point of a cover object, so a cover point can be passed around without an actor of its own
+USTRUCT(BlueprintType)
+struct GUNSLINGERS_API FCoverPointRef
+{
+	GENERATED_BODY()
+
+	FCoverPointRef() {}
+	FCoverPointRef(class ACoverObject* InCoverObject, int32 InIndex) : CoverObject(InCoverObject), Index(InIndex) {}
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Cover")
+	class ACoverObject* CoverObject = nullptr;
+
+	//Index into the cover object's CoverPoints
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Cover")
+	int32 Index = INDEX_NONE;
+
+	//The cover point, or nullptr if the cover object has gone, no longer has it or it is disabled
+	const FCoverPoint* Get() const;
+
+	bool IsValid() const { return Get() != nullptr; }
+
+	bool operator==(const FCoverPointRef& other) const { return CoverObject == other.CoverObject && Index == other.Index; }
+	bool operator!=(const FCoverPointRef& other) const { return !(*this == other); }
+};
+
 UCLASS()
 class GUNSLINGERS_API ACoverObject : public AActor
 {
@@ -15,13 +87,17 @@ public:
 	// Sets default values for this actor's properties
 	ACoverObject();
 
-	//Stores a reference to the coverBP that should be spawned around the mesh
-	UPROPERTY(EditAnywhere, Category = "Components")
-	TSubclassOf<class ACover> CoverBP;
-
-	//Stores a reference to each of the cover objects around the cover mesh
+	//Each cover point around the cover mesh, plain data in world space rather than an actor per point. Saved with the level once baked
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Components")
-	TArray<AActor*> MyCovers;
+	TArray<FCoverPoint> CoverPoints;
+
+	//Whether CoverPoints were baked in the editor, so BeginPlay only has to load them
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Bake")
+	bool CoverPointsBaked = false;
+
+	//Where the cover object was when it was baked, if it has been moved since the points are worked out again at runtime
+	UPROPERTY()
+	FTransform BakedTransform;
 
 	//Mesh declaration
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Components")
@@ -31,14 +107,92 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
 	float CoverRange = 10.f;
 
-	//Can be called by ai to recieve the furthest cover object to player (This will be the one opposite the player, so that they are covered from player)
+	//Covers up to this tall are low cover that can be shot over standing up
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	float LowCoverMaxHeight = 120.f;
+
+	//Sides of the collision hull that turn by less than this many degrees are merged into one cover point, so rounded meshes do not get a point per facet
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	float CoverEdgeMergeAngle = 30.f;
+
+	//Sides shorter than this after merging are too small to take cover behind
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	float MinCoverEdgeLength = 40.f;
+
+	//Works out the cover points along each side of the mesh's collision hull, seen from above. Falls back to the sides of the mesh bounds if it has no collision. Does not need the game to be running so it can be used by bakes
 	UFUNCTION(BlueprintCallable, Category = "Utility")
+	void CalculateCoverPoints(TArray<FCoverPoint>& outPoints) const;
+
+	//The same for any static mesh placed at transform, so meshes that are not cover objects of their own get the same cover points
+	static void CalculateMeshCoverPoints(const class UStaticMesh* mesh, const FTransform& transform, float coverRange, float lowCoverMaxHeight, float coverEdgeMergeAngle, float minCoverEdgeLength, TArray<FCoverPoint>& outPoints);
+
+	//Traces around every point that does not have its Exposure yet, all in one parallel batch. Only the level's geometry blocks the traces, not characters
+	static void CalculateExposure(const class UWorld* world, TArray<FCoverPoint>& points);
+
+	//Spawns a cover object with no mesh that already has its cover points, for cover that is not a placed mesh of its own
+	static ACoverObject* SpawnWithCoverPoints(class UWorld* world, const FVector& location, const TArray<FCoverPoint>& coverPoints, AActor* owner);
+
+	//Works out CoverPoints now so they are saved with the level
+	UFUNCTION(CallInEditor, Category = "Bake")
+	void BakeCoverPoints();
+
+	//Whether the baked points are there and the cover object has not moved since
+	bool HasCurrentBake() const { return CoverPointsBaked && BakedTransform.Equals(GetActorTransform()); }
+
+	//Can be called by ai to recieve the furthest cover object to player (This will be the one opposite the player, so that they are covered from player). Returns a marker actor moved onto the furthest cover point, kept for Blueprints written against the old cover actors
+	UFUNCTION(BlueprintCallable, Category = "Utility", meta = (DeprecatedFunction, DeprecationMessage = "Use GetFurthestCoverLocationToPlayer, cover points are no longer actors"))
 	AActor* GetFurthestCoverToPlayer();
 
+	//Where to stand at the furthest cover point to player, the cover object's location if it has none
+	UFUNCTION(BlueprintCallable, Category = "Utility")
+	FVector GetFurthestCoverLocationToPlayer();
+
+	//Index in CoverPoints of the furthest enabled cover point to the player, INDEX_NONE if there are none
+	UFUNCTION(BlueprintCallable, Category = "Utility")
+	int32 GetFurthestCoverPointToPlayer();
+
+	//LIFECYCLE
+
+	//Moves the cover and its cover points with it, for cover that can be pushed around. The AI director updates only this cover and tells the AI holding it
+	UFUNCTION(BlueprintCallable, Category = "Cover")
+	void MoveCover(FTransform newTransform);
+
+	//Turns one side of the cover on or off. A cover with every point disabled is skipped by the AI director and the AI holding it is told to look again
+	UFUNCTION(BlueprintCallable, Category = "Cover")
+	void SetCoverPointEnabled(int32 index, bool enabled);
+
+	//Disables a side that has been shot apart, the cover object is destroyed along with its last side
+	UFUNCTION(BlueprintCallable, Category = "Cover")
+	void DestroyCoverPoint(int32 index);
+
+	//True if the cover has cover points and every one of them is disabled
+	UFUNCTION(BlueprintPure, Category = "Cover")
+	bool IsCoverDisabled() const;
+
 protected:
+	//Spawned the first time GetFurthestCoverToPlayer is called
+	UPROPERTY(Transient)
+	class ACover* FurthestCoverMarker;
+
+	//Tells every player's ghost to pick its cover again, as the cover it picked may be this one
+	void MarkPlayerGhostsDirty() const;
+
+	//Exposure traces for the points that came without it, and which point each run of rays belongs to
+	TArray<FTraceHandle> ExposureTraces;
+	TArray<int32> ExposureTracePoints;
+
+	//The async version of CalculateExposure, queues the traces for every point missing its exposure
+	void StartExposureTraces();
+
+	//Fills in the exposure once every trace is back, and waits another frame if some are not
+	void CollectExposureTraces();
+
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	// Called when removed from the world (including when its sublevel streams out), unregisters from the AI director
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 
 public:	
 	// Called every frame
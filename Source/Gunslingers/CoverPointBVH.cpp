@@ -0,0 +1,227 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverPointBVH.h"
+#include "Algo/Sort.h"
+
+namespace
+{
+	//Boxes per leaf, testing a few boxes is cheaper than descending another level
+	const int32 MaxBoxesPerLeaf = 4;
+
+	//Slab test of a ray in the box's own space, returns the entry distance or a negative number on a miss
+	float IntersectRayAABB(const FVector& origin, const FVector& direction, float length, const FVector& boxMin, const FVector& boxMax)
+	{
+		float tMin = 0.f;
+		float tMax = length;
+		for (int32 axis = 0; axis < 3; axis++)
+		{
+			if (FMath::Abs(direction[axis]) < SMALL_NUMBER)
+			{
+				//Parallel to the slab, so it is either always inside it or never
+				if (origin[axis] < boxMin[axis] || origin[axis] > boxMax[axis])
+				{
+					return -1.f;
+				}
+				continue;
+			}
+			const float invDirection = 1.f / direction[axis];
+			float t1 = (boxMin[axis] - origin[axis]) * invDirection;
+			float t2 = (boxMax[axis] - origin[axis]) * invDirection;
+			if (t1 > t2)
+			{
+				Swap(t1, t2);
+			}
+			tMin = FMath::Max(tMin, t1);
+			tMax = FMath::Min(tMax, t2);
+			if (tMin > tMax)
+			{
+				return -1.f;
+			}
+		}
+		return tMin;
+	}
+
+	//World space bounds of the rotated box, the extent along each world axis is the sum of every local axis projected onto it
+	FBox GetWorldBounds(const FVector& center, const FQuat& rotation, const FVector& extent)
+	{
+		const FVector axisX = rotation.GetAxisX() * extent.X;
+		const FVector axisY = rotation.GetAxisY() * extent.Y;
+		const FVector axisZ = rotation.GetAxisZ() * extent.Z;
+		const FVector worldExtent = axisX.GetAbs() + axisY.GetAbs() + axisZ.GetAbs();
+		return FBox(center - worldExtent, center + worldExtent);
+	}
+}
+
+void FCoverPointBVH::Reset()
+{
+	Centers.Reset();
+	Rotations.Reset();
+	Extents.Reset();
+	Payloads.Reset();
+	WorldBounds.Reset();
+	DisabledBoxes.Reset();
+	Nodes.Reset();
+	Order.Reset();
+	Parents.Reset();
+	BoxLeaves.Reset();
+}
+
+void FCoverPointBVH::Add(const FVector& center, const FQuat& rotation, const FVector& extent, int32 payload)
+{
+	Centers.Add(center);
+	Rotations.Add(rotation);
+	Extents.Add(extent);
+	Payloads.Add(payload);
+	WorldBounds.Add(GetWorldBounds(center, rotation, extent));
+	DisabledBoxes.Add(false);
+}
+
+void FCoverPointBVH::Build()
+{
+	Nodes.Reset();
+	Order.Reset();
+	Parents.Reset();
+	BoxLeaves.Init(INDEX_NONE, Centers.Num());
+	for (int32 i = 0; i < Centers.Num(); i++)
+	{
+		Order.Add(i);
+	}
+	if (Order.Num() > 0)
+	{
+		Nodes.Reserve(2 * Order.Num() / MaxBoxesPerLeaf + 1);
+		BuildNode(0, Order.Num(), INDEX_NONE);
+	}
+}
+
+int32 FCoverPointBVH::BuildNode(int32 first, int32 num, int32 parent)
+{
+	const int32 nodeIndex = Nodes.AddDefaulted();
+	Parents.Add(parent);
+	FBox bounds(ForceInit);
+	FBox centerBounds(ForceInit);
+	for (int32 i = first; i < first + num; i++)
+	{
+		bounds += WorldBounds[Order[i]];
+		centerBounds += Centers[Order[i]];
+	}
+	Nodes[nodeIndex].Bounds = bounds;
+
+	if (num <= MaxBoxesPerLeaf)
+	{
+		Nodes[nodeIndex].First = first;
+		Nodes[nodeIndex].Num = num;
+		Nodes[nodeIndex].SecondChild = INDEX_NONE;
+		for (int32 i = first; i < first + num; i++)
+		{
+			BoxLeaves[Order[i]] = nodeIndex;
+		}
+		return nodeIndex;
+	}
+
+	//Split at the median centre along the longest axis, so the tree is always balanced
+	const FVector size = centerBounds.GetSize();
+	const int32 axis = size.X >= size.Y && size.X >= size.Z ? 0 : (size.Y >= size.Z ? 1 : 2);
+	const int32 half = num / 2;
+	TArrayView<int32> range(Order.GetData() + first, num);
+	Algo::Sort(range, [this, axis](int32 a, int32 b) { return Centers[a][axis] < Centers[b][axis]; });
+
+	Nodes[nodeIndex].First = first;
+	Nodes[nodeIndex].Num = 0;
+	BuildNode(first, half, nodeIndex);
+	const int32 secondChild = BuildNode(first + half, num - half, nodeIndex);
+	Nodes[nodeIndex].SecondChild = secondChild;
+	return nodeIndex;
+}
+
+void FCoverPointBVH::Update(int32 box, const FVector& center, const FQuat& rotation, const FVector& extent)
+{
+	Centers[box] = center;
+	Rotations[box] = rotation;
+	Extents[box] = extent;
+	WorldBounds[box] = GetWorldBounds(center, rotation, extent);
+	if (!BoxLeaves.IsValidIndex(box))
+	{
+		return;
+	}
+
+	//Each node on the way up is refit from its own boxes or its two children, which are already up to date
+	for (int32 nodeIndex = BoxLeaves[box]; nodeIndex != INDEX_NONE; nodeIndex = Parents[nodeIndex])
+	{
+		FNode& node = Nodes[nodeIndex];
+		if (node.Num > 0)
+		{
+			FBox bounds(ForceInit);
+			for (int32 i = node.First; i < node.First + node.Num; i++)
+			{
+				bounds += WorldBounds[Order[i]];
+			}
+			node.Bounds = bounds;
+		}
+		else
+		{
+			node.Bounds = Nodes[nodeIndex + 1].Bounds + Nodes[node.SecondChild].Bounds;
+		}
+	}
+}
+
+void FCoverPointBVH::SetEnabled(int32 box, bool enabled)
+{
+	DisabledBoxes[box] = !enabled;
+}
+
+float FCoverPointBVH::IntersectRayBox(const FVector& origin, const FVector& direction, float length, const FVector& center, const FQuat& rotation, const FVector& extent)
+{
+	//Move the ray into the box's space so it is an axis aligned test
+	const FVector localOrigin = rotation.UnrotateVector(origin - center);
+	const FVector localDirection = rotation.UnrotateVector(direction);
+	return IntersectRayAABB(localOrigin, localDirection, length, -extent, extent);
+}
+
+void FCoverPointBVH::Raycast(const FVector& origin, const FVector& direction, float length, TArray<FCoverPointHit>& outHits) const
+{
+	outHits.Reset();
+	if (Nodes.Num() == 0)
+	{
+		return;
+	}
+
+	TArray<int32, TInlineAllocator<32>> stack;
+	stack.Add(0);
+	while (stack.Num() > 0)
+	{
+		const int32 nodeIndex = stack.Pop(false);
+		const FNode& node = Nodes[nodeIndex];
+		if (IntersectRayAABB(origin, direction, length, node.Bounds.Min, node.Bounds.Max) < 0.f)
+		{
+			continue;
+		}
+
+		if (node.Num > 0)
+		{
+			for (int32 i = node.First; i < node.First + node.Num; i++)
+			{
+				const int32 box = Order[i];
+				if (DisabledBoxes[box])
+				{
+					continue;
+				}
+				const float distance = IntersectRayBox(origin, direction, length, Centers[box], Rotations[box], Extents[box]);
+				if (distance >= 0.f)
+				{
+					FCoverPointHit hit;
+					hit.Payload = Payloads[box];
+					hit.Distance = distance;
+					outHits.Add(hit);
+				}
+			}
+		}
+		else
+		{
+			stack.Add(node.SecondChild);
+			stack.Add(nodeIndex + 1);
+		}
+	}
+
+	outHits.Sort([](const FCoverPointHit& a, const FCoverPointHit& b) { return a.Distance < b.Distance; });
+}
@@ -0,0 +1,67 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//One box a ray passed through
+struct FCoverPointHit
+{
+	//Whatever the box was added with, the AI director uses the index of the cover point
+	int32 Payload;
+	//How far along the ray it was entered, zero if the ray starts inside it
+	float Distance;
+};
+
+//Bounding volume hierarchy over the oriented boxes of cover points, so a ray can be tested against every cover in the level without the physics scene
+struct GUNSLINGERS_API FCoverPointBVH
+{
+public:
+	void Reset();
+
+	//Adds a box with its centre, rotation and half size. Build has to be called before the next raycast
+	void Add(const FVector& center, const FQuat& rotation, const FVector& extent, int32 payload);
+
+	//Builds the tree over every box added so far
+	void Build();
+
+	//Moves a box that is already in the tree and refits the nodes above it, only its path to the root is touched. The tree is not rebalanced, so it only gets slower to search if boxes move far from where they were built
+	void Update(int32 box, const FVector& center, const FQuat& rotation, const FVector& extent);
+
+	//Disabled boxes stay in the tree but are never hit
+	void SetEnabled(int32 box, bool enabled);
+
+	//Fills outHits with every box the ray passes through within length, nearest first. direction must be normalized
+	void Raycast(const FVector& origin, const FVector& direction, float length, TArray<FCoverPointHit>& outHits) const;
+
+	int32 Num() const { return Centers.Num(); }
+
+	//Distance along the ray it enters an oriented box, or a negative number if it misses it within length
+	static float IntersectRayBox(const FVector& origin, const FVector& direction, float length, const FVector& center, const FQuat& rotation, const FVector& extent);
+
+private:
+	//Leaves hold a run of Order, inner nodes have their first child straight after them and their second at SecondChild
+	struct FNode
+	{
+		FBox Bounds;
+		int32 First;
+		int32 Num;
+		int32 SecondChild;
+	};
+
+	int32 BuildNode(int32 first, int32 num, int32 parent);
+
+	//Boxes as structure-of-arrays
+	TArray<FVector> Centers;
+	TArray<FQuat> Rotations;
+	TArray<FVector> Extents;
+	TArray<int32> Payloads;
+	TArray<FBox> WorldBounds;
+	TBitArray<> DisabledBoxes;
+
+	TArray<FNode> Nodes;
+	TArray<int32> Order;
+	//Parent of each node, INDEX_NONE for the root, and the leaf each box is in, so an update can walk up from a box
+	TArray<int32> Parents;
+	TArray<int32> BoxLeaves;
+};
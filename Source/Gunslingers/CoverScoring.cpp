@@ -0,0 +1,303 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverScoring.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+
+//SSE is only used on x86 platforms, NEON and FPU-only platforms run the scalar kernel
+#if PLATFORM_ENABLE_VECTORINTRINSICS && !PLATFORM_ENABLE_VECTORINTRINSICS_NEON
+#define COVER_SCORING_SSE 1
+#include <emmintrin.h>
+#else
+#define COVER_SCORING_SSE 0
+#endif
+
+static TAutoConsoleVariable<int32> CVarCoverScalarScoring(
+	TEXT("ai.Cover.ScalarScoring"),
+	0,
+	TEXT("If non-zero the AI director scores covers with the scalar kernel instead of the SIMD one."));
+
+void CoverScoring::ScoreCoversScalar(const FCoverScoringInput& input, const float* x, const float* y, const float* z, int32 num, uint8* outMasks, float* outDistancesToAI)
+{
+	//Direction from the AI to the player, used by the advancing test, is the same for every cover
+	const float playerToAIX = input.PlayerLocation.X - input.AILocation.X;
+	const float playerToAIY = input.PlayerLocation.Y - input.AILocation.Y;
+	const float playerToAIZ = input.PlayerLocation.Z - input.AILocation.Z;
+	const float minDistanceSquared = input.MinDistanceFromPlayer * input.MinDistanceFromPlayer;
+	const int32 numOtherThreats = input.OtherThreatX.Num();
+
+	for (int i = 0; i < num; i++)
+	{
+		//Vector from the player to the cover
+		const float coverFromPlayerX = x[i] - input.PlayerLocation.X;
+		const float coverFromPlayerY = y[i] - input.PlayerLocation.Y;
+		const float coverFromPlayerZ = z[i] - input.PlayerLocation.Z;
+
+		//Vector from the AI to the cover
+		const float coverFromAIX = x[i] - input.AILocation.X;
+		const float coverFromAIY = y[i] - input.AILocation.Y;
+		const float coverFromAIZ = z[i] - input.AILocation.Z;
+
+		const float distanceToPlayer = FMath::Sqrt(coverFromPlayerX * coverFromPlayerX + coverFromPlayerY * coverFromPlayerY + coverFromPlayerZ * coverFromPlayerZ);
+		const float distanceToAI = FMath::Sqrt(coverFromAIX * coverFromAIX + coverFromAIY * coverFromAIY + coverFromAIZ * coverFromAIZ);
+		outDistancesToAI[i] = distanceToAI;
+
+		//Too far and the AI would have to advance, too close and they would have to retreat
+		bool inBand = distanceToPlayer < input.MaxDistanceFromPlayer && distanceToPlayer > input.MinDistanceFromPlayer;
+		//Nor can it be too close to any other player
+		for (int t = 0; t < numOtherThreats; t++)
+		{
+			const float coverFromThreatX = x[i] - input.OtherThreatX[t];
+			const float coverFromThreatY = y[i] - input.OtherThreatY[t];
+			const float coverFromThreatZ = z[i] - input.OtherThreatZ[t];
+			inBand = inBand && (coverFromThreatX * coverFromThreatX + coverFromThreatY * coverFromThreatY + coverFromThreatZ * coverFromThreatZ) > minDistanceSquared;
+		}
+		if (!inBand)
+		{
+			outMasks[i] = ECoverScoringMask::None;
+			continue;
+		}
+
+		//Only the sign of each dot product is tested so the vectors don't need normalizing
+		const float playerDot = input.PlayerForward.X * coverFromPlayerX + input.PlayerForward.Y * coverFromPlayerY + input.PlayerForward.Z * coverFromPlayerZ;
+		const float aiDot = input.AIForward.X * coverFromAIX + input.AIForward.Y * coverFromAIY + input.AIForward.Z * coverFromAIZ;
+		//Negative when the cover and the AI are looking at the player from the same side
+		const float sideDot = coverFromPlayerX * playerToAIX + coverFromPlayerY * playerToAIY + coverFromPlayerZ * playerToAIZ;
+
+		uint8 mask = ECoverScoringMask::None;
+		if (distanceToAI <= input.NormalCoverRange)
+		{
+			mask |= ECoverScoringMask::Normal;
+		}
+		if (playerDot < 0)
+		{
+			mask |= ECoverScoringMask::Flanking;
+		}
+		if (aiDot > 0 && sideDot < 0)
+		{
+			mask |= ECoverScoringMask::Advancing;
+		}
+		if (aiDot < 0)
+		{
+			mask |= ECoverScoringMask::Retreating;
+		}
+		outMasks[i] = mask;
+	}
+}
+
+void CoverScoring::ScoreCovers(const FCoverScoringInput& input, const float* x, const float* y, const float* z, int32 num, uint8* outMasks, float* outDistancesToAI)
+{
+	int i = 0;
+
+#if COVER_SCORING_SSE
+	if (CVarCoverScalarScoring.GetValueOnAnyThread() == 0)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 minDistance = _mm_set1_ps(input.MinDistanceFromPlayer);
+		const __m128 maxDistance = _mm_set1_ps(input.MaxDistanceFromPlayer);
+		const __m128 normalRange = _mm_set1_ps(input.NormalCoverRange);
+
+		const __m128 playerX = _mm_set1_ps(input.PlayerLocation.X);
+		const __m128 playerY = _mm_set1_ps(input.PlayerLocation.Y);
+		const __m128 playerZ = _mm_set1_ps(input.PlayerLocation.Z);
+		const __m128 playerForwardX = _mm_set1_ps(input.PlayerForward.X);
+		const __m128 playerForwardY = _mm_set1_ps(input.PlayerForward.Y);
+		const __m128 playerForwardZ = _mm_set1_ps(input.PlayerForward.Z);
+
+		const __m128 aiX = _mm_set1_ps(input.AILocation.X);
+		const __m128 aiY = _mm_set1_ps(input.AILocation.Y);
+		const __m128 aiZ = _mm_set1_ps(input.AILocation.Z);
+		const __m128 aiForwardX = _mm_set1_ps(input.AIForward.X);
+		const __m128 aiForwardY = _mm_set1_ps(input.AIForward.Y);
+		const __m128 aiForwardZ = _mm_set1_ps(input.AIForward.Z);
+
+		const __m128 playerToAIX = _mm_set1_ps(input.PlayerLocation.X - input.AILocation.X);
+		const __m128 playerToAIY = _mm_set1_ps(input.PlayerLocation.Y - input.AILocation.Y);
+		const __m128 playerToAIZ = _mm_set1_ps(input.PlayerLocation.Z - input.AILocation.Z);
+
+		const __m128 minDistanceSquared = _mm_set1_ps(input.MinDistanceFromPlayer * input.MinDistanceFromPlayer);
+		const int32 numOtherThreats = input.OtherThreatX.Num();
+
+		//Four covers per iteration, every operation is in the same order as the scalar kernel so both give bit identical results
+		for (; i + 4 <= num; i += 4)
+		{
+			const __m128 coverX = _mm_loadu_ps(x + i);
+			const __m128 coverY = _mm_loadu_ps(y + i);
+			const __m128 coverZ = _mm_loadu_ps(z + i);
+
+			const __m128 coverFromPlayerX = _mm_sub_ps(coverX, playerX);
+			const __m128 coverFromPlayerY = _mm_sub_ps(coverY, playerY);
+			const __m128 coverFromPlayerZ = _mm_sub_ps(coverZ, playerZ);
+
+			const __m128 coverFromAIX = _mm_sub_ps(coverX, aiX);
+			const __m128 coverFromAIY = _mm_sub_ps(coverY, aiY);
+			const __m128 coverFromAIZ = _mm_sub_ps(coverZ, aiZ);
+
+			const __m128 distanceToPlayer = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(coverFromPlayerX, coverFromPlayerX), _mm_mul_ps(coverFromPlayerY, coverFromPlayerY)), _mm_mul_ps(coverFromPlayerZ, coverFromPlayerZ)));
+			const __m128 distanceToAI = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(coverFromAIX, coverFromAIX), _mm_mul_ps(coverFromAIY, coverFromAIY)), _mm_mul_ps(coverFromAIZ, coverFromAIZ)));
+			_mm_storeu_ps(outDistancesToAI + i, distanceToAI);
+
+			__m128 inBand = _mm_and_ps(_mm_cmplt_ps(distanceToPlayer, maxDistance), _mm_cmpgt_ps(distanceToPlayer, minDistance));
+			//Every other threat is tested against the same four covers
+			for (int t = 0; t < numOtherThreats; t++)
+			{
+				const __m128 coverFromThreatX = _mm_sub_ps(coverX, _mm_set1_ps(input.OtherThreatX[t]));
+				const __m128 coverFromThreatY = _mm_sub_ps(coverY, _mm_set1_ps(input.OtherThreatY[t]));
+				const __m128 coverFromThreatZ = _mm_sub_ps(coverZ, _mm_set1_ps(input.OtherThreatZ[t]));
+				const __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(coverFromThreatX, coverFromThreatX), _mm_mul_ps(coverFromThreatY, coverFromThreatY)), _mm_mul_ps(coverFromThreatZ, coverFromThreatZ));
+				inBand = _mm_and_ps(inBand, _mm_cmpgt_ps(distanceSquared, minDistanceSquared));
+			}
+
+			const __m128 playerDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(playerForwardX, coverFromPlayerX), _mm_mul_ps(playerForwardY, coverFromPlayerY)), _mm_mul_ps(playerForwardZ, coverFromPlayerZ));
+			const __m128 aiDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aiForwardX, coverFromAIX), _mm_mul_ps(aiForwardY, coverFromAIY)), _mm_mul_ps(aiForwardZ, coverFromAIZ));
+			const __m128 sideDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(coverFromPlayerX, playerToAIX), _mm_mul_ps(coverFromPlayerY, playerToAIY)), _mm_mul_ps(coverFromPlayerZ, playerToAIZ));
+
+			const int normalBits = _mm_movemask_ps(_mm_and_ps(inBand, _mm_cmple_ps(distanceToAI, normalRange)));
+			const int flankingBits = _mm_movemask_ps(_mm_and_ps(inBand, _mm_cmplt_ps(playerDot, zero)));
+			const int advancingBits = _mm_movemask_ps(_mm_and_ps(inBand, _mm_and_ps(_mm_cmpgt_ps(aiDot, zero), _mm_cmplt_ps(sideDot, zero))));
+			const int retreatingBits = _mm_movemask_ps(_mm_and_ps(inBand, _mm_cmplt_ps(aiDot, zero)));
+
+			for (int lane = 0; lane < 4; lane++)
+			{
+				outMasks[i + lane] = (((normalBits >> lane) & 1) * ECoverScoringMask::Normal)
+					| (((flankingBits >> lane) & 1) * ECoverScoringMask::Flanking)
+					| (((advancingBits >> lane) & 1) * ECoverScoringMask::Advancing)
+					| (((retreatingBits >> lane) & 1) * ECoverScoringMask::Retreating);
+			}
+		}
+	}
+#endif
+
+	//Whatever is left over (or everything on platforms without SSE)
+	if (i < num)
+	{
+		ScoreCoversScalar(input, x + i, y + i, z + i, num - i, outMasks + i, outDistancesToAI + i);
+	}
+}
+
+#if WITH_DEV_AUTOMATION_TESTS
+//Normalizes each direction and uses FVector maths like the original scoring, nothing is shared with the kernel
+uint8 CoverScoring::ScoreCoverReference(const FCoverScoringInput& input, const FVector& coverLoc)
+{
+	float distanceBetweenCoverAndPlayer = (input.PlayerLocation - coverLoc).Size();
+	if (!(distanceBetweenCoverAndPlayer < input.MaxDistanceFromPlayer && distanceBetweenCoverAndPlayer > input.MinDistanceFromPlayer))
+	{
+		return ECoverScoringMask::None;
+	}
+	for (int t = 0; t < input.OtherThreatX.Num(); t++)
+	{
+		if (!((FVector(input.OtherThreatX[t], input.OtherThreatY[t], input.OtherThreatZ[t]) - coverLoc).SizeSquared() > input.MinDistanceFromPlayer * input.MinDistanceFromPlayer))
+		{
+			return ECoverScoringMask::None;
+		}
+	}
+
+	uint8 mask = ECoverScoringMask::None;
+
+	if ((input.AILocation - coverLoc).Size() <= input.NormalCoverRange)
+	{
+		mask |= ECoverScoringMask::Normal;
+	}
+
+	FVector directionalVectorBetweenPlayerAndCover = coverLoc - input.PlayerLocation;
+	directionalVectorBetweenPlayerAndCover.Normalize();
+	if (FVector::DotProduct(input.PlayerForward, directionalVectorBetweenPlayerAndCover) < 0)
+	{
+		mask |= ECoverScoringMask::Flanking;
+	}
+
+	FVector directionalVectorBetweenCoverAndAI = coverLoc - input.AILocation;
+	directionalVectorBetweenCoverAndAI.Normalize();
+	float dotProduct = FVector::DotProduct(input.AIForward, directionalVectorBetweenCoverAndAI);
+	if (dotProduct < 0)
+	{
+		mask |= ECoverScoringMask::Retreating;
+	}
+	if (dotProduct > 0)
+	{
+		FVector directionalVectorBetweenAIAndPlayer = input.PlayerLocation - input.AILocation;
+		directionalVectorBetweenAIAndPlayer.Normalize();
+		FVector directionalVectorBetweenCoverAndPlayer = input.PlayerLocation - coverLoc;
+		directionalVectorBetweenCoverAndPlayer.Normalize();
+		if (FVector::DotProduct(directionalVectorBetweenCoverAndPlayer, directionalVectorBetweenAIAndPlayer) > 0)
+		{
+			mask |= ECoverScoringMask::Advancing;
+		}
+	}
+
+	return mask;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCoverScoringKernelTest, "Gunslingers.Cover.ScoringKernel", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+//Scores randomized cover layouts with the SIMD kernel, the scalar kernel and the original FVector maths and fails on any cover where they disagree
+bool FCoverScoringKernelTest::RunTest(const FString& Parameters)
+{
+	const int32 numLayouts = 100;
+	FRandomStream random(1234);
+
+	int32 kernelMismatches = 0;
+	int32 referenceMismatches = 0;
+
+	for (int layout = 0; layout < numLayouts; layout++)
+	{
+		FCoverScoringInput input;
+		input.PlayerLocation = FVector(random.FRandRange(-5000.f, 5000.f), random.FRandRange(-5000.f, 5000.f), random.FRandRange(0.f, 500.f));
+		input.PlayerForward = random.GetUnitVector().GetSafeNormal2D();
+		input.AILocation = input.PlayerLocation + FVector(random.FRandRange(-2000.f, 2000.f), random.FRandRange(-2000.f, 2000.f), 0.f);
+		//Any facing, so AI already turned away from the player take the retreating and advancing branches both ways
+		input.AIForward = random.GetUnitVector().GetSafeNormal2D();
+		input.MinDistanceFromPlayer = 400.f;
+		input.MaxDistanceFromPlayer = 1500.f;
+		//Up to three other co-op players
+		const int32 numOtherThreats = random.RandRange(0, 3);
+		for (int t = 0; t < numOtherThreats; t++)
+		{
+			input.OtherThreatX.Add(input.PlayerLocation.X + random.FRandRange(-1500.f, 1500.f));
+			input.OtherThreatY.Add(input.PlayerLocation.Y + random.FRandRange(-1500.f, 1500.f));
+			input.OtherThreatZ.Add(input.PlayerLocation.Z);
+		}
+
+		//Odd sizes so the scalar tail after the SIMD loop is exercised too
+		const int32 num = random.RandRange(1, 259);
+		TArray<float> x, y, z;
+		for (int i = 0; i < num; i++)
+		{
+			x.Add(input.PlayerLocation.X + random.FRandRange(-2000.f, 2000.f));
+			y.Add(input.PlayerLocation.Y + random.FRandRange(-2000.f, 2000.f));
+			z.Add(input.PlayerLocation.Z + random.FRandRange(-100.f, 100.f));
+		}
+
+		TArray<uint8> masks, scalarMasks;
+		TArray<float> distances, scalarDistances;
+		masks.SetNumUninitialized(num);
+		scalarMasks.SetNumUninitialized(num);
+		distances.SetNumUninitialized(num);
+		scalarDistances.SetNumUninitialized(num);
+
+		CoverScoring::ScoreCovers(input, x.GetData(), y.GetData(), z.GetData(), num, masks.GetData(), distances.GetData());
+		CoverScoring::ScoreCoversScalar(input, x.GetData(), y.GetData(), z.GetData(), num, scalarMasks.GetData(), scalarDistances.GetData());
+
+		for (int i = 0; i < num; i++)
+		{
+			if (masks[i] != scalarMasks[i] || distances[i] != scalarDistances[i])
+			{
+				AddError(FString::Printf(TEXT("Layout %d cover %d: SIMD mask %d distance %f, scalar mask %d distance %f"), layout, i, masks[i], distances[i], scalarMasks[i], scalarDistances[i]));
+				kernelMismatches++;
+			}
+			const uint8 referenceMask = CoverScoring::ScoreCoverReference(input, FVector(x[i], y[i], z[i]));
+			if (masks[i] != referenceMask)
+			{
+				AddError(FString::Printf(TEXT("Layout %d cover %d: kernel mask %d, original scoring mask %d"), layout, i, masks[i], referenceMask));
+				referenceMismatches++;
+			}
+		}
+	}
+
+	TestEqual(TEXT("SIMD/scalar mismatches"), kernelMismatches, 0);
+	TestEqual(TEXT("Mismatches against the original scoring"), referenceMismatches, 0);
+	return true;
+}
+#endif
@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Bits written by the scoring kernel for each cover, one per movement type that the cover is valid for
+namespace ECoverScoringMask
+{
+	enum Type : uint8
+	{
+		None = 0,
+		Normal = 1 << 0,
+		Flanking = 1 << 1,
+		Advancing = 1 << 2,
+		Retreating = 1 << 3
+	};
+}
+
+//Everything the kernel needs to know about the threats and the AI asking for cover
+struct GUNSLINGERS_API FCoverScoringInput
+{
+	//The threat the AI is reacting to (the nearest or most dangerous player), flanking, advancing and retreating are all relative to it
+	FVector PlayerLocation = FVector::ZeroVector;
+	FVector PlayerForward = FVector::ZeroVector;
+	FVector AILocation = FVector::ZeroVector;
+	FVector AIForward = FVector::ZeroVector;
+
+	//Covers must be strictly between these distances from the player to be valid for any movement type
+	float MinDistanceFromPlayer = 0.f;
+	float MaxDistanceFromPlayer = 0.f;
+
+	//How close a cover has to be to the AI to be normal cover
+	float NormalCoverRange = 800.f;
+
+	//Every other threat as structure-of-arrays. Covers that are not further than MinDistanceFromPlayer from all of them are not valid for any movement type
+	TArray<float, TInlineAllocator<4>> OtherThreatX;
+	TArray<float, TInlineAllocator<4>> OtherThreatY;
+	TArray<float, TInlineAllocator<4>> OtherThreatZ;
+
+	//Danger map sampled at each valid cover, not read by the kernel itself. nullptr to ignore danger
+	const struct FCoverInfluenceMap* Influence = nullptr;
+	//How much ranking distance one unit of danger is worth
+	float DangerCost = 0.f;
+
+	//Exposure of each cover by id, FCoverPoint::NumExposureSectors bytes per cover in world space, not read by the kernel itself. nullptr to ignore exposure
+	const uint8* CoverExposure = nullptr;
+	//How much ranking distance a cover fully open towards the player is worth
+	float ExposureCost = 0.f;
+};
+
+namespace CoverScoring
+{
+	//Evaluates num covers stored as structure-of-arrays. For each cover writes the ECoverScoringMask bits it is valid for and its distance to the AI.
+	//Uses SSE to test four covers per instruction where available, otherwise (or when ai.Cover.ScalarScoring is set) falls back to ScoreCoversScalar
+	GUNSLINGERS_API void ScoreCovers(const FCoverScoringInput& input, const float* x, const float* y, const float* z, int32 num, uint8* outMasks, float* outDistancesToAI);
+
+	//Scalar version of the kernel, performs exactly the same arithmetic as each SIMD lane
+	GUNSLINGERS_API void ScoreCoversScalar(const FCoverScoringInput& input, const float* x, const float* y, const float* z, int32 num, uint8* outMasks, float* outDistancesToAI);
+
+#if WITH_DEV_AUTOMATION_TESTS
+	//Scores one cover exactly the way the AI director did before the kernel existed. Only used by tests to check the kernel and the director's queries against
+	GUNSLINGERS_API uint8 ScoreCoverReference(const FCoverScoringInput& input, const FVector& coverLoc);
+#endif
+}
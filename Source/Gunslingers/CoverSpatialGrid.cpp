@@ -0,0 +1,244 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoverSpatialGrid.h"
+
+void FCoverGridCell::Add(int32 id, const FVector& location, const FVector& forward)
+{
+	Ids.Add(id);
+	X.Add(location.X);
+	Y.Add(location.Y);
+	Z.Add(location.Z);
+	ForwardX.Add(forward.X);
+	ForwardY.Add(forward.Y);
+	ForwardZ.Add(forward.Z);
+}
+
+void FCoverGridCell::RemoveAtSwap(int32 index)
+{
+	Ids.RemoveAtSwap(index);
+	X.RemoveAtSwap(index);
+	Y.RemoveAtSwap(index);
+	Z.RemoveAtSwap(index);
+	ForwardX.RemoveAtSwap(index);
+	ForwardY.RemoveAtSwap(index);
+	ForwardZ.RemoveAtSwap(index);
+}
+
+FCoverSpatialGrid::FCoverSpatialGrid()
+	: MinCell(MAX_int32, MAX_int32, MAX_int32)
+	, MaxCell(MIN_int32, MIN_int32, MIN_int32)
+	, CellSize(500.f)
+	, NumCovers(0)
+{
+}
+
+void FCoverSpatialGrid::Reset(float InCellSize)
+{
+	Cells.Reset();
+	CellOfCover.Reset();
+	MinCell = FIntVector(MAX_int32, MAX_int32, MAX_int32);
+	MaxCell = FIntVector(MIN_int32, MIN_int32, MIN_int32);
+	CellSize = FMath::Max(InCellSize, 1.f);
+	NumCovers = 0;
+}
+
+FIntVector FCoverSpatialGrid::GetCell(const FVector& location) const
+{
+	return FIntVector(FMath::FloorToInt(location.X / CellSize), FMath::FloorToInt(location.Y / CellSize), FMath::FloorToInt(location.Z / CellSize));
+}
+
+void FCoverSpatialGrid::Add(int32 id, const FVector& location, const FVector& forward)
+{
+	if (id == INDEX_NONE || CellOfCover.Contains(id))
+	{
+		return;
+	}
+
+	FIntVector cell = GetCell(location);
+	Cells.FindOrAdd(cell).Add(id, location, forward);
+	CellOfCover.Add(id, cell);
+	NumCovers++;
+
+	MinCell = FIntVector(FMath::Min(MinCell.X, cell.X), FMath::Min(MinCell.Y, cell.Y), FMath::Min(MinCell.Z, cell.Z));
+	MaxCell = FIntVector(FMath::Max(MaxCell.X, cell.X), FMath::Max(MaxCell.Y, cell.Y), FMath::Max(MaxCell.Z, cell.Z));
+}
+
+bool FCoverSpatialGrid::Remove(int32 id)
+{
+	FIntVector cell;
+	if (!CellOfCover.RemoveAndCopyValue(id, cell))
+	{
+		return false;
+	}
+
+	FCoverGridCell& gridCell = Cells.FindChecked(cell);
+	int32 index = gridCell.Ids.Find(id);
+	if (index != INDEX_NONE)
+	{
+		gridCell.RemoveAtSwap(index);
+	}
+	if (gridCell.Num() == 0)
+	{
+		Cells.Remove(cell);
+		//Only a cell on the edge of the bounds can shrink them
+		if (cell.X == MinCell.X || cell.Y == MinCell.Y || cell.Z == MinCell.Z || cell.X == MaxCell.X || cell.Y == MaxCell.Y || cell.Z == MaxCell.Z)
+		{
+			RecalculateBounds();
+		}
+	}
+	NumCovers--;
+	return true;
+}
+
+void FCoverSpatialGrid::RecalculateBounds()
+{
+	MinCell = FIntVector(MAX_int32, MAX_int32, MAX_int32);
+	MaxCell = FIntVector(MIN_int32, MIN_int32, MIN_int32);
+	for (const TPair<FIntVector, FCoverGridCell>& pair : Cells)
+	{
+		const FIntVector& cell = pair.Key;
+		MinCell = FIntVector(FMath::Min(MinCell.X, cell.X), FMath::Min(MinCell.Y, cell.Y), FMath::Min(MinCell.Z, cell.Z));
+		MaxCell = FIntVector(FMath::Max(MaxCell.X, cell.X), FMath::Max(MaxCell.Y, cell.Y), FMath::Max(MaxCell.Z, cell.Z));
+	}
+}
+
+bool FCoverSpatialGrid::Contains(int32 id) const
+{
+	return CellOfCover.Contains(id);
+}
+
+void FCoverSpatialGrid::ForEachCellInAnnulus(const FVector& center, float minRadius, float maxRadius, TFunctionRef<void(const FCoverGridCell&)> visitor) const
+{
+	if (NumCovers == 0 || maxRadius <= 0.f)
+	{
+		return;
+	}
+
+	//Only cells overlapping the bounding box of the outer sphere (and that have ever held a cover) can contain an answer
+	FIntVector lowCell = GetCell(center - FVector(maxRadius));
+	FIntVector highCell = GetCell(center + FVector(maxRadius));
+	lowCell = FIntVector(FMath::Max(lowCell.X, MinCell.X), FMath::Max(lowCell.Y, MinCell.Y), FMath::Max(lowCell.Z, MinCell.Z));
+	highCell = FIntVector(FMath::Min(highCell.X, MaxCell.X), FMath::Min(highCell.Y, MaxCell.Y), FMath::Min(highCell.Z, MaxCell.Z));
+
+	const float maxRadiusSquared = maxRadius * maxRadius;
+	const float minRadiusSquared = minRadius > 0.f ? minRadius * minRadius : -1.f;
+
+	for (int x = lowCell.X; x <= highCell.X; x++)
+	{
+		for (int y = lowCell.Y; y <= highCell.Y; y++)
+		{
+			for (int z = lowCell.Z; z <= highCell.Z; z++)
+			{
+				const FCoverGridCell* gridCell = Cells.Find(FIntVector(x, y, z));
+				if (gridCell == nullptr)
+				{
+					continue;
+				}
+
+				//Skip the cell if it is completely outside the outer radius or completely inside the inner radius
+				FVector cellMin(x * CellSize, y * CellSize, z * CellSize);
+				FVector cellMax = cellMin + FVector(CellSize);
+				FVector closestPoint(FMath::Clamp(center.X, cellMin.X, cellMax.X), FMath::Clamp(center.Y, cellMin.Y, cellMax.Y), FMath::Clamp(center.Z, cellMin.Z, cellMax.Z));
+				if ((closestPoint - center).SizeSquared() > maxRadiusSquared)
+				{
+					continue;
+				}
+				FVector furthestOffset(FMath::Max(FMath::Abs(center.X - cellMin.X), FMath::Abs(center.X - cellMax.X)),
+					FMath::Max(FMath::Abs(center.Y - cellMin.Y), FMath::Abs(center.Y - cellMax.Y)),
+					FMath::Max(FMath::Abs(center.Z - cellMin.Z), FMath::Abs(center.Z - cellMax.Z)));
+				if (furthestOffset.SizeSquared() < minRadiusSquared)
+				{
+					continue;
+				}
+
+				visitor(*gridCell);
+			}
+		}
+	}
+}
+
+int32 FCoverSpatialGrid::FindNearest(const FVector& pos, TFunctionRef<bool(int32)> isAvailable) const
+{
+	if (NumCovers == 0)
+	{
+		return INDEX_NONE;
+	}
+
+	FIntVector centerCell = GetCell(pos);
+
+	//The search can stop once the ring reaches past the furthest occupied cell
+	int maxRing = 0;
+	maxRing = FMath::Max(maxRing, FMath::Max(FMath::Abs(centerCell.X - MinCell.X), FMath::Abs(centerCell.X - MaxCell.X)));
+	maxRing = FMath::Max(maxRing, FMath::Max(FMath::Abs(centerCell.Y - MinCell.Y), FMath::Abs(centerCell.Y - MaxCell.Y)));
+	maxRing = FMath::Max(maxRing, FMath::Max(FMath::Abs(centerCell.Z - MinCell.Z), FMath::Abs(centerCell.Z - MaxCell.Z)));
+
+	int32 currentWinner = INDEX_NONE;
+	float currentClosestDistance = MAX_flt;
+
+	//Visits every cell of a block of cells that is inside the bounds
+	auto visitBlock = [&](int lowX, int highX, int lowY, int highY, int lowZ, int highZ)
+	{
+		lowX = FMath::Max(lowX, MinCell.X);
+		lowY = FMath::Max(lowY, MinCell.Y);
+		lowZ = FMath::Max(lowZ, MinCell.Z);
+		highX = FMath::Min(highX, MaxCell.X);
+		highY = FMath::Min(highY, MaxCell.Y);
+		highZ = FMath::Min(highZ, MaxCell.Z);
+		//A face past the bounds on any axis has nothing to walk
+		if (lowX > highX || lowY > highY || lowZ > highZ)
+		{
+			return;
+		}
+		for (int x = lowX; x <= highX; x++)
+		{
+			for (int y = lowY; y <= highY; y++)
+			{
+				for (int z = lowZ; z <= highZ; z++)
+				{
+					const FCoverGridCell* gridCell = Cells.Find(FIntVector(x, y, z));
+					if (gridCell == nullptr)
+					{
+						continue;
+					}
+
+					for (int i = 0; i < gridCell->Num(); i++)
+					{
+						float tmpDistance = (gridCell->GetLocation(i) - pos).Size();
+						if (tmpDistance < currentClosestDistance && isAvailable(gridCell->Ids[i]))
+						{
+							currentClosestDistance = tmpDistance;
+							currentWinner = gridCell->Ids[i];
+						}
+					}
+				}
+			}
+		}
+	};
+
+	//Search shells of cells outwards from the cell pos is in. Only the six faces of each shell are walked, the cells inside were visited by the previous rings
+	for (int ring = 0; ring <= maxRing; ring++)
+	{
+		const FIntVector low = centerCell - FIntVector(ring, ring, ring);
+		const FIntVector high = centerCell + FIntVector(ring, ring, ring);
+
+		//Bottom and top faces whole, then the front and back faces without the rows those had, then the sides without any edge
+		visitBlock(low.X, high.X, low.Y, high.Y, low.Z, low.Z);
+		if (ring > 0)
+		{
+			visitBlock(low.X, high.X, low.Y, high.Y, high.Z, high.Z);
+			visitBlock(low.X, high.X, low.Y, low.Y, low.Z + 1, high.Z - 1);
+			visitBlock(low.X, high.X, high.Y, high.Y, low.Z + 1, high.Z - 1);
+			visitBlock(low.X, low.X, low.Y + 1, high.Y - 1, low.Z + 1, high.Z - 1);
+			visitBlock(high.X, high.X, low.Y + 1, high.Y - 1, low.Z + 1, high.Z - 1);
+		}
+
+		//Anything in the next ring is at least this far away, so if the winner is closer than that it can't be beaten
+		if (currentWinner != INDEX_NONE && currentClosestDistance <= ring * CellSize)
+		{
+			break;
+		}
+	}
+
+	return currentWinner;
+}
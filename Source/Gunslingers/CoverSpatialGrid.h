@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//One cell of the cover grid. Positions and facing vectors are packed as structure-of-arrays so the scoring kernel can load several covers per instruction
+struct GUNSLINGERS_API FCoverGridCell
+{
+	//Stable id of each cover, owned by whoever fills the grid (the AI director uses the index into its cover table)
+	TArray<int32> Ids;
+
+	TArray<float> X;
+	TArray<float> Y;
+	TArray<float> Z;
+
+	TArray<float> ForwardX;
+	TArray<float> ForwardY;
+	TArray<float> ForwardZ;
+
+	int32 Num() const { return Ids.Num(); }
+
+	FVector GetLocation(int32 index) const { return FVector(X[index], Y[index], Z[index]); }
+	FVector GetForward(int32 index) const { return FVector(ForwardX[index], ForwardY[index], ForwardZ[index]); }
+
+	void Add(int32 id, const FVector& location, const FVector& forward);
+	void RemoveAtSwap(int32 index);
+};
+
+//Uniform 3D grid over cover positions, used by the AI director so range and nearest queries only visit the cells that can contain an answer instead of every cover in the level
+struct GUNSLINGERS_API FCoverSpatialGrid
+{
+public:
+	FCoverSpatialGrid();
+
+	//Removes every cover and sets the size of each cell, cells should be roughly the size of the smallest query radius
+	void Reset(float InCellSize);
+
+	//Adds a cover at the given location, the location and facing are cached so queries never have to touch the actor
+	void Add(int32 id, const FVector& location, const FVector& forward);
+
+	//Removes a cover, returns false if it was not in the grid
+	bool Remove(int32 id);
+
+	bool Contains(int32 id) const;
+
+	int32 Num() const { return NumCovers; }
+
+	//Calls visitor for every cell that may hold a cover whose distance to center is strictly between minRadius and maxRadius. Covers in the cell still need the exact distance test
+	void ForEachCellInAnnulus(const FVector& center, float minRadius, float maxRadius, TFunctionRef<void(const FCoverGridCell&)> visitor) const;
+
+	//Returns the id of the closest cover to pos that isAvailable accepts, or INDEX_NONE if there is none
+	int32 FindNearest(const FVector& pos, TFunctionRef<bool(int32)> isAvailable) const;
+
+private:
+	FIntVector GetCell(const FVector& location) const;
+
+	//Works MinCell and MaxCell out again from the cells that are left
+	void RecalculateBounds();
+
+	TMap<FIntVector, FCoverGridCell> Cells;
+
+	//Which cell each cover lives in so it can be removed without a search
+	TMap<int32, FIntVector> CellOfCover;
+
+	//Bounds of every cell holding a cover, queries are clamped to this
+	FIntVector MinCell;
+	FIntVector MaxCell;
+
+	float CellSize;
+
+	int32 NumCovers;
+};
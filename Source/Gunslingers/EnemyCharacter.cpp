@@ -3,6 +3,7 @@
 
 #include "EnemyCharacter.h"
 #include "Weapon.h"
+#include "AIDirector.h"
 
 // Sets default values
 AEnemyCharacter::AEnemyCharacter()
@@ -16,7 +17,31 @@ AEnemyCharacter::AEnemyCharacter()
 void AEnemyCharacter::BeginPlay()
 {
 	Super::BeginPlay();
-	
+
+	//The director checks this enemy's line of sight and cover in the background
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->RegisterAgent(this);
+	}
+}
+
+void AEnemyCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	//Dead enemies should not keep other AI out of their cover
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->ReleaseCoversOwnedBy(this);
+		director->UnregisterAgent(this);
+		//Somewhere an enemy was just killed is somewhere the others should avoid for a while
+		if (EndPlayReason == EEndPlayReason::Destroyed)
+		{
+			director->ReportDeath(GetActorLocation());
+		}
+	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
 void AEnemyCharacter::ShootEnemyWeapon()
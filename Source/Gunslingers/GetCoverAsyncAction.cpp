@@ -0,0 +1,39 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GetCoverAsyncAction.h"
+
+UGetCoverAsyncAction * UGetCoverAsyncAction::GetCoverAsync(UObject * worldContextObject, FVector pos, FVector forward, AActor * coverAIIsIn, MovementTypes movementType, AActor * requester)
+{
+	UGetCoverAsyncAction* action = NewObject<UGetCoverAsyncAction>();
+	action->WorldContextObject = worldContextObject;
+	action->Request.Position = pos;
+	action->Request.Forward = forward;
+	action->Request.CurrentCover = coverAIIsIn;
+	action->Request.MovementType = movementType;
+	action->Request.Requester = requester;
+	action->RegisterWithGameInstance(worldContextObject);
+	return action;
+}
+
+void UGetCoverAsyncAction::Activate()
+{
+	AAIDirector* director = AAIDirector::Get(WorldContextObject);
+	//Without a director there is nothing to ask, so stay in the cover already in like GetCover does when nothing is valid
+	if (director == nullptr)
+	{
+		Completed.Broadcast(Request.CurrentCover);
+		SetReadyToDestroy();
+		return;
+	}
+
+	TWeakObjectPtr<UGetCoverAsyncAction> weakThis(this);
+	director->RequestCoverAsync(Request, [weakThis](AActor* cover)
+	{
+		if (weakThis.IsValid())
+		{
+			weakThis->Completed.Broadcast(cover);
+			weakThis->SetReadyToDestroy();
+		}
+	});
+}
@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintAsyncActionBase.h"
+#include "AIDirector.h"
+#include "GetCoverAsyncAction.generated.h"
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCoverFound, AActor*, Cover);
+
+//Latent Blueprint version of AAIDirector::GetCover, the query runs on a worker thread and Completed fires on a later tick
+UCLASS()
+class GUNSLINGERS_API UGetCoverAsyncAction : public UBlueprintAsyncActionBase
+{
+	GENERATED_BODY()
+
+public:
+	//Fires once with the cover found, nullptr if the requester was destroyed while it waited
+	UPROPERTY(BlueprintAssignable)
+	FOnCoverFound Completed;
+
+	UFUNCTION(BlueprintCallable, Category = "AI", meta = (BlueprintInternalUseOnly = "true", WorldContext = "worldContextObject", DisplayName = "Get Cover Async"))
+	static UGetCoverAsyncAction* GetCoverAsync(UObject* worldContextObject, FVector pos, FVector forward, AActor* coverAIIsIn, MovementTypes movementType, AActor* requester);
+
+	virtual void Activate() override;
+
+protected:
+	UPROPERTY()
+	UObject* WorldContextObject;
+
+	UPROPERTY()
+	FCoverRequest Request;
+};
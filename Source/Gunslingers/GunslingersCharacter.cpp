@@ -2,7 +2,6 @@
 
 #include "GunslingersCharacter.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
-#include "Blueprint/AIBlueprintHelperLibrary.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
@@ -18,13 +17,16 @@
 #include "Kismet/GameplayStatics.h"
 
 #include "Weapon.h"
-#include "Cover.h"
 #include "CoverObject.h"
+#include "InstancedCoverObject.h"
+#include "AIDirector.h"
+#include "CoverMovementComponent.h"
 
 //////////////////////////////////////////////////////////////////////////
 // AGunslingersCharacter
 
-AGunslingersCharacter::AGunslingersCharacter()
+AGunslingersCharacter::AGunslingersCharacter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer.SetDefaultSubobjectClass<UCoverMovementComponent>(ACharacter::CharacterMovementComponentName))
 {
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(42.f, 96.0f);	
@@ -43,6 +45,7 @@ AGunslingersCharacter::AGunslingersCharacter()
 	GetCharacterMovement()->RotationRate = FRotator(0.0f, 540.0f, 0.0f); // ...at this rotation rate
 	GetCharacterMovement()->JumpZVelocity = 600.f;
 	GetCharacterMovement()->AirControl = 0.2f;
+	CoverMovement = Cast<UCoverMovementComponent>(GetCharacterMovement());
 
 	// Create a camera boom (pulls in towards the player if there is a collision)
 	CameraBoom = CreateDefaultSubobject<USpringArmComponent>(TEXT("CameraBoom"));
@@ -55,13 +58,13 @@ AGunslingersCharacter::AGunslingersCharacter()
 	FollowCamera->SetupAttachment(CameraBoom, USpringArmComponent::SocketName); // Attach the camera to the end of the boom and let the boom adjust to match the controller orientation
 	FollowCamera->bUsePawnControlRotation = false; // Camera does not rotate relative to arm
 
-	//Probe for when in cover and for going to cover
+	//Probe for when in cover and for going to cover, only read by Blueprints now
 	CollisionProbe = CreateDefaultSubobject<UBoxComponent>(TEXT("CollisionProbe"));
 	CollisionProbe->SetBoxExtent(FVector(1000.f, 2.f, 2.f));
 
-	//Probe for when crouching outside of cover
+	//Probe for when crouching outside of cover, in cover the cover point's own height and exposure are used instead
 	OutOfCoverCollisionProbe = CreateDefaultSubobject<UBoxComponent>(TEXT("OutOfCoverProbe"));
-	CollisionProbe->SetBoxExtent(FVector(80.f, 2.f, 2.f));
+	OutOfCoverCollisionProbe->SetBoxExtent(FVector(80.f, 2.f, 2.f));
 
 	//Create skeletal mesh for the ghost player
 	GhostPlayer = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("GhostPlayer"));	
@@ -127,45 +130,87 @@ void AGunslingersCharacter::BeginPlay()
 	//Set to invisible at start
 
 	GhostPlayer->SetVisibility(false);
+
+	//Track what the probe overlaps through events instead of asking every frame. Anything already overlapping has had its events before these were bound, so it is picked up here once
+	OutOfCoverCollisionProbe->OnComponentBeginOverlap.AddDynamic(this, &AGunslingersCharacter::OnCoverProbeBeginOverlap);
+	OutOfCoverCollisionProbe->OnComponentEndOverlap.AddDynamic(this, &AGunslingersCharacter::OnCoverProbeEndOverlap);
+	TArray<AActor*> overlapping;
+	OutOfCoverCollisionProbe->GetOverlappingActors(overlapping);
+	for (AActor* actor : overlapping)
+	{
+		TArray<AActor*>* probeSet = GetProbeSet(OutOfCoverCollisionProbe, actor);
+		if (probeSet)
+		{
+			probeSet->AddUnique(actor);
+		}
+	}
+	GhostDirty = true;
+
+	//Let the AI know there is a player to take cover from
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->RegisterThreat(this);
+	}
+}
+
+void AGunslingersCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->UnregisterThreat(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
 //Sets player to be in cover and moves them to it
 void AGunslingersCharacter::SetInCover()
 {
 	IsInCover = true;
-	SetGhostVisibility(false, nullptr);
-	UAIBlueprintHelperLibrary::SimpleMoveToActor(GetController(), CurrentCover);	
+	CurrentCover = CurrentCoverPoint.CoverObject;
+	SetGhostVisibilityAtCoverPoint(false, FCoverPointRef());
+	//Straight onto the cover's edge, no path needed
+	CoverMovement->EnterCover(CurrentCoverPoint);
 	Crouch();
 	IsCrouching = true;
 	GetCharacterMovement()->MaxWalkSpeed = 300.f;	
 
 }
 
+void AGunslingersCharacter::LeaveCover()
+{
+	CurrentCoverPoint = FCoverPointRef();
+	CurrentCover = nullptr;
+	IsInCover = false;
+}
 
 void AGunslingersCharacter::Cover()
 {
 	//Get best cover
-	AActor* potentialCover = GetBestCover();
+	FCoverPointRef potentialCover = GetBestCover();
 	//If there is no good cover then set not in cover
-	if (potentialCover == nullptr)
+	if (!potentialCover.IsValid())
 	{
-		CurrentCover = nullptr;
-		IsInCover = false;
+		CoverMovement->ExitCover();
+		LeaveCover();
 	}
 	//If there is a good cover set that to current cover
 	else
 	{
-		CurrentCover = potentialCover;
+		CurrentCoverPoint = potentialCover;
 		SetInCover();
 	}
 }
 
-void AGunslingersCharacter::SetGhostVisibility(bool input, AActor* coverForGhost)
+void AGunslingersCharacter::SetGhostVisibilityAtCoverPoint(bool input, const FCoverPointRef& coverForGhost)
 {
-	if (input && coverForGhost != nullptr && IsDead != true)
+	const FCoverPoint* coverPoint = coverForGhost.Get();
+	if (input && coverPoint != nullptr && IsDead != true)
 	{
-		GhostPlayer->SetWorldLocation(FVector(coverForGhost->GetActorLocation().X, coverForGhost->GetActorLocation().Y, coverForGhost->GetActorLocation().Z - 50.f));
-		GhostPlayer->SetWorldRotation(coverForGhost->GetActorRotation());
+		GhostPlayer->SetWorldLocation(FVector(coverPoint->Location.X, coverPoint->Location.Y, coverPoint->Location.Z - 50.f));
+		GhostPlayer->SetWorldRotation(coverPoint->Rotation);
 		GhostPlayer->AddWorldRotation(FRotator(0.f, -90.f, 0.f));
 		GhostPlayer->SetVisibility(true);
 	}
@@ -176,17 +221,52 @@ void AGunslingersCharacter::SetGhostVisibility(bool input, AActor* coverForGhost
 
 }
 
-AActor * AGunslingersCharacter::GetBestCover()
+void AGunslingersCharacter::SetGhostVisibility(bool input, AActor * coverForGhost)
 {
-	//Get all cover actors overlapping the probe
-	TArray<AActor*> CoverObjects;
-	AActor* CoverToReturn = nullptr;
-	CollisionProbe->GetOverlappingActors(CoverObjects, ACover::StaticClass());
+	//Cover markers are owned by the cover object they mark a side of
+	ACoverObject* coverObject = Cast<ACoverObject>(coverForGhost);
+	if (coverObject == nullptr && coverForGhost)
+	{
+		coverObject = Cast<ACoverObject>(coverForGhost->GetOwner());
+	}
+	if (coverObject == nullptr)
+	{
+		SetGhostVisibilityAtCoverPoint(false, FCoverPointRef());
+		return;
+	}
+
+	const FVector target = coverObject == coverForGhost ? GetActorLocation() : coverForGhost->GetActorLocation();
+	int32 nearest = INDEX_NONE;
+	float nearestDistanceSquared = MAX_flt;
+	for (int32 i = 0; i < coverObject->CoverPoints.Num(); i++)
+	{
+		const FCoverPoint& point = coverObject->CoverPoints[i];
+		const float distanceSquared = FVector::DistSquared(point.Location, target);
+		if (point.Enabled && distanceSquared < nearestDistanceSquared)
+		{
+			nearestDistanceSquared = distanceSquared;
+			nearest = i;
+		}
+	}
+	SetGhostVisibilityAtCoverPoint(input, FCoverPointRef(coverObject, nearest));
+}
+
+AActor * AGunslingersCharacter::GetCurrentCoverActor() const
+{
+	return IsInCover ? CurrentCoverPoint.CoverObject : nullptr;
+}
+
+FCoverPointRef AGunslingersCharacter::GetBestCover()
+{
+	//Get all covers along the camera's view
+	TArray<FCoverPointRef> CoverObjects = PickedCovers;
+	//Covers picked before one of them moved, lost a side or was destroyed can no longer be taken
+	CoverObjects.RemoveAll([](const FCoverPointRef& cover) { return !cover.IsValid(); });
 
 	//If there are no cover objects it means the player is not looking at their own or a new cover, so must leave cover.
 	if (CoverObjects.Num() == 0)
 	{
-		return nullptr;
+		return FCoverPointRef();
 	}
 	//If there is a current cover
 	else if (IsInCover)
@@ -195,9 +275,9 @@ AActor * AGunslingersCharacter::GetBestCover()
 		if (CoverObjects.Num() >= 2)
 		{
 			//If current cover is in there remove it
-			if (CoverObjects.Contains(CurrentCover))
+			if (CoverObjects.Contains(CurrentCoverPoint))
 			{
-				CoverObjects.Remove(CurrentCover);
+				CoverObjects.Remove(CurrentCoverPoint);
 			}
 
 			int closestCover = 0;
@@ -214,9 +294,9 @@ AActor * AGunslingersCharacter::GetBestCover()
 		else
 		{
 			//If the current cover is still equal to the potential cover, it means the player is only looking at their own cover and wants to exit 
-			if (CurrentCover == CoverObjects[0])
+			if (CurrentCoverPoint == CoverObjects[0])
 			{
-				return nullptr;
+				return FCoverPointRef();
 			}
 			//Else the potential cover is new, and the player should move to it
 			else
@@ -238,7 +318,7 @@ AActor * AGunslingersCharacter::GetBestCover()
 	}
 
 	//If there is some problem return null
-	return nullptr;
+	return FCoverPointRef();
 }
 
 void AGunslingersCharacter::Aim()
@@ -247,10 +327,9 @@ void AGunslingersCharacter::Aim()
 	IsAiming = true;
 	if (IsInCover)
 	{
-		//If aiming is clicked there is a check to see if the probe is overlapping a cover mesh, if so we want to stand to see over it
-		TArray<AActor*> CoverObjects;
-		CollisionProbe->GetOverlappingActors(CoverObjects, ACoverObject::StaticClass());
-		if (CoverObjects.Num() > 0)
+		//Low cover can be stood up over to shoot, high cover cannot. The height was worked out with the cover point so nothing is queried here
+		const FCoverPoint* coverPoint = CurrentCoverPoint.Get();
+		if (coverPoint && coverPoint->Height == CoverHeights::LowCover)
 		{
 			UnCrouch();
 			IsCrouching = false;
@@ -297,16 +376,9 @@ void AGunslingersCharacter::ShootWeaponButton()
 		{
 			if (IsInCover)
 			{
-				//Check to make sure we are not overlapping any covers, or at least not our own, before shooting while in cover
-				TArray<AActor*> CoverObjects;
-				AActor* parent = CurrentCover->GetAttachParentActor();
-				CollisionProbe->GetOverlappingActors(CoverObjects, ACoverObject::StaticClass());
-				if (CoverObjects.Num() < 1)
-				{
-					EquipedWeapon->FireWeapon();
-				}
-				//Or does not contain parent
-				else if (!CoverObjects.Contains(parent))
+				//A crouched shot only gets out if the cover does not block the direction the camera is aiming, read from the cover point's exposure rather than the physics scene
+				const FCoverPoint* coverPoint = CurrentCoverPoint.Get();
+				if (coverPoint == nullptr || coverPoint->GetExposure(FollowCamera->GetForwardVector()) >= CrouchedShotMinExposure)
 				{
 					EquipedWeapon->FireWeapon();
 				}
@@ -314,9 +386,7 @@ void AGunslingersCharacter::ShootWeaponButton()
 			else
 			{
 				//If not in cover but still crouching use different probe, with overlapping any cover mesh stopping shooting
-				TArray<AActor*> CoverObjects;
-				OutOfCoverCollisionProbe->GetOverlappingActors(CoverObjects, ACoverObject::StaticClass());
-				if (CoverObjects.Num() < 1)
+				if (OutOfCoverProbeCoverObjects.Num() < 1)
 				{
 					EquipedWeapon->FireWeapon();
 				}
@@ -401,16 +471,22 @@ void AGunslingersCharacter::Menu()
 }
 
 //Used to determine which side the player ought to move to 
-int AGunslingersCharacter::CalculateClosestCover(TArray<AActor*> covers)
+int AGunslingersCharacter::CalculateClosestCover(const TArray<FCoverPointRef>& covers)
 {
 	//Find smallest distance, by default this will be the first
-	float smallestDistance = (GetActorLocation() - covers[0]->GetActorLocation()).SizeSquared();
+	float smallestDistance = MAX_flt;
 	int arrayPointer = 0;
 
 
-	for (int i = 1; i < covers.Num(); i++)
+	for (int i = 0; i < covers.Num(); i++)
 	{
-		float tmpDistance = (GetActorLocation() - covers[i]->GetActorLocation()).SizeSquared();
+		//Skip covers that have gone since they were picked
+		const FCoverPoint* coverPoint = covers[i].Get();
+		if (coverPoint == nullptr)
+		{
+			continue;
+		}
+		float tmpDistance = (GetActorLocation() - coverPoint->Location).SizeSquared();
 		//If closer than best make the current 'winner'
 		if (tmpDistance < smallestDistance)
 		{
@@ -424,6 +500,82 @@ int AGunslingersCharacter::CalculateClosestCover(TArray<AActor*> covers)
 }
 
 
+TArray<AActor*>* AGunslingersCharacter::GetProbeSet(UPrimitiveComponent* probe, AActor* otherActor)
+{
+	//Instanced cover meshes belong to the instanced cover actor rather than a cover object
+	const bool isCover = otherActor->IsA<ACoverObject>() || otherActor->IsA<AInstancedCoverObject>();
+	if (probe == OutOfCoverCollisionProbe && isCover)
+	{
+		return &OutOfCoverProbeCoverObjects;
+	}
+	return nullptr;
+}
+
+void AGunslingersCharacter::OnCoverProbeBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult)
+{
+	TArray<AActor*>* probeSet = OtherActor ? GetProbeSet(OverlappedComponent, OtherActor) : nullptr;
+	if (probeSet && !probeSet->Contains(OtherActor))
+	{
+		probeSet->Add(OtherActor);
+		GhostDirty = true;
+	}
+}
+
+void AGunslingersCharacter::OnCoverProbeEndOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex)
+{
+	//An actor with several components is still overlapping until the last one stops
+	TArray<AActor*>* probeSet = OtherActor ? GetProbeSet(OverlappedComponent, OtherActor) : nullptr;
+	if (probeSet && !OverlappedComponent->IsOverlappingActor(OtherActor))
+	{
+		probeSet->Remove(OtherActor);
+		GhostDirty = true;
+	}
+}
+
+void AGunslingersCharacter::UpdateGhost()
+{
+	//Which cover is picked only changes when the camera moves or turns far enough, or the cover state changes
+	const FVector location = FollowCamera->GetComponentLocation();
+	const FRotator rotation = FollowCamera->GetComponentRotation();
+	if (!GhostDirty
+		&& FVector::DistSquared(location, GhostCameraLocation) < CoverProbeMoveThreshold * CoverProbeMoveThreshold
+		&& rotation.Equals(GhostCameraRotation, CoverProbeRotationThreshold)
+		&& IsInCover == GhostWasInCover && CurrentCoverPoint == GhostCurrentCover && IsDead == GhostWasDead)
+	{
+		return;
+	}
+	GhostDirty = false;
+	GhostCameraLocation = location;
+	GhostCameraRotation = rotation;
+	GhostWasInCover = IsInCover;
+	GhostCurrentCover = CurrentCoverPoint;
+	GhostWasDead = IsDead;
+
+	PickedCovers.Reset();
+	AAIDirector* director = AAIDirector::Get(this);
+	if (director)
+	{
+		director->RaycastCoverPoints(location, rotation.Vector(), CoverPickRange, PickedCovers);
+	}
+
+	FCoverPointRef ghostCover = GetBestCover();
+	//Nothing to move if the ghost is already showing the same cover
+	if (ghostCover == GhostCover && GhostPlayer->IsVisible() == (ghostCover.IsValid() && !IsDead))
+	{
+		return;
+	}
+	GhostCover = ghostCover;
+
+	if (!ghostCover.IsValid())
+	{
+		SetGhostVisibilityAtCoverPoint(false, FCoverPointRef());
+	}
+	else
+	{
+		SetGhostVisibilityAtCoverPoint(true, ghostCover);
+	}
+}
+
 FVector AGunslingersCharacter::GetPawnViewLocation() const
 {
 	if (FollowCamera)
@@ -438,17 +590,14 @@ void AGunslingersCharacter::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	AActor* ghostCover = GetBestCover();
-
-	if (ghostCover == nullptr)
+	//The movement component ends cover by itself when the player steps away or anything else takes over the movement
+	if (IsInCover && !CoverMovement->IsInCoverMovement())
 	{
-		SetGhostVisibility(false, nullptr);
-	}
-	else
-	{
-		SetGhostVisibility(true, ghostCover);
+		LeaveCover();
 	}
 
+	UpdateGhost();
+
 	//Slow mo either drains or regens over time
 	if (IsSlowMo)
 	{
@@ -510,11 +659,6 @@ void AGunslingersCharacter::MoveForward(float Value)
 {
 	if ((Controller != NULL) && (Value != 0.0f))
 	{
-		//If there is a valid path return
-		if (UAIBlueprintHelperLibrary::GetCurrentPath(GetController()))
-		{
-			return;
-		}
 		// find out which way is forward
 		const FRotator Rotation = Controller->GetControlRotation();
 		const FRotator YawRotation(0, Rotation.Yaw, 0);
@@ -531,11 +675,6 @@ void AGunslingersCharacter::MoveRight(float Value)
 {
 	if ( (Controller != NULL) && (Value != 0.0f))
 	{
-		//If there is a valid path return
-		if (UAIBlueprintHelperLibrary::GetCurrentPath(GetController()))
-		{
-			return;
-		}
 		// find out which way is right
 		const FRotator Rotation = Controller->GetControlRotation();
 		const FRotator YawRotation(0, Rotation.Yaw, 0);
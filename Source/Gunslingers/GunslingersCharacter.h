@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
+#include "CoverObject.h"
 #include "GunslingersCharacter.generated.h"
 
 UCLASS(config=Game)
@@ -19,7 +20,7 @@ class AGunslingersCharacter : public ACharacter
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class UCameraComponent* FollowCamera;
 public:
-	AGunslingersCharacter();
+	AGunslingersCharacter(const FObjectInitializer& ObjectInitializer);
 
 	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
@@ -78,8 +79,18 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;	
 
+	// Called when removed from the world, stops the AI taking cover from this player
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	void SetInCover();
 
+	//Clears the cover state when the player has stepped, jumped or fallen out of cover
+	void LeaveCover();
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Movement)
+	class UCoverMovementComponent* CoverMovement;
+
+	//The long probe crouched shots used to check before cover points had exposure. Nothing in C++ reads it, it is kept because ThirdPersonCharacter still does
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Cover)
 	class UBoxComponent* CollisionProbe;
 
@@ -89,8 +100,36 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Cover)
 	class USkeletalMeshComponent* GhostPlayer;
 
+	//How far along the camera's view covers can be picked
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Cover)
+	float CoverPickRange = 2000.f;
+
+	//How far the camera has to move, and how many degrees turn, before the best cover and ghost are worked out again when the cover state has not changed
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Cover)
+	float CoverProbeMoveThreshold = 25.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Cover)
+	float CoverProbeRotationThreshold = 2.f;
+
+	//Covers the camera's view passes through, nearest first, worked out against the AI director's cover point boxes instead of the physics scene
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Transient, Category = Cover)
+	TArray<FCoverPointRef> PickedCovers;
+
+	//Cover objects overlapping the probe, kept up to date by overlap events so nothing has to query for them
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Transient, Category = Cover)
+	TArray<AActor*> OutOfCoverProbeCoverObjects;
+
+	//Shooting crouched in cover is blocked in directions the cover leaves less exposed than this, 0 to 1
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Cover)
-	AActor* CurrentCover;
+	float CrouchedShotMinExposure = 0.5f;
+
+	//The cover point the player is in
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Cover)
+	FCoverPointRef CurrentCoverPoint;
+
+	//The cover object the player is in, for Blueprints written when cover points were actors. Only kept up to date, nothing reads it back
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Transient, Category = Cover, meta = (DeprecatedProperty, DeprecationMessage = "Use CurrentCoverPoint or GetCurrentCoverActor"))
+	AActor* CurrentCover = nullptr;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Weapon)
 	class AWeapon* EquipedWeapon;
@@ -126,10 +165,18 @@ protected:
 	void Cover();	
 
 	UFUNCTION(BlueprintCallable, Category = Cover)
+	void SetGhostVisibilityAtCoverPoint(bool input, const FCoverPointRef& coverForGhost);
+
+	//Shows the ghost at the side of cover the actor stands for, a cover marker's own point or the side of a cover object nearest the player
+	UFUNCTION(BlueprintCallable, Category = Cover, meta = (DeprecatedFunction, DeprecationMessage = "Use SetGhostVisibilityAtCoverPoint, cover points are no longer actors"))
 	void SetGhostVisibility(bool input, AActor* coverForGhost);
 
+	//The cover object the player is in, or nullptr if they are not in cover
+	UFUNCTION(BlueprintPure, Category = Cover)
+	AActor* GetCurrentCoverActor() const;
+
 	UFUNCTION(BlueprintCallable, Category = Cover)
-	AActor* GetBestCover();
+	FCoverPointRef GetBestCover();
 
 	UFUNCTION(BlueprintCallable, Category = "Weapon")
 	void Aim();
@@ -158,7 +205,28 @@ protected:
 	UFUNCTION(BlueprintCallable, Category = "Control")
 	void Menu();
 
-	int CalculateClosestCover(TArray<AActor*> covers);
+	int CalculateClosestCover(const TArray<FCoverPointRef>& covers);
+
+	UFUNCTION()
+	void OnCoverProbeBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult);
+
+	UFUNCTION()
+	void OnCoverProbeEndOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex);
+
+	//The set of actors overlapping a probe that OtherActor belongs in, or nullptr if it is not cover
+	TArray<AActor*>* GetProbeSet(UPrimitiveComponent* probe, AActor* otherActor);
+
+	//Works out the best cover and moves the ghost only when something it depends on has changed
+	void UpdateGhost();
+
+	//What the ghost was last worked out from
+	bool GhostDirty = true;
+	FCoverPointRef GhostCover;
+	FVector GhostCameraLocation = FVector::ZeroVector;
+	FRotator GhostCameraRotation = FRotator::ZeroRotator;
+	bool GhostWasInCover = false;
+	FCoverPointRef GhostCurrentCover;
+	bool GhostWasDead = false;
 	
 
 
@@ -170,9 +238,16 @@ public:
 	FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
 	/** Returns FollowCamera subobject **/
 	FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
+	/** Returns the cover the player is in, or nullptr if they are not in cover **/
+	FORCEINLINE FCoverPointRef GetCurrentCover() const { return IsInCover ? CurrentCoverPoint : FCoverPointRef(); }
+	/** Returns the movement component, which takes the player into and along cover **/
+	FORCEINLINE class UCoverMovementComponent* GetCoverMovement() const { return CoverMovement; }
 
 	virtual FVector GetPawnViewLocation() const override;
 
+	//Called by cover objects when they move, lose a side or go, so the covers picked for the ghost are looked for again
+	void MarkGhostDirty() { GhostDirty = true; }
+
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
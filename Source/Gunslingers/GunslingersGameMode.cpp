@@ -4,6 +4,9 @@
 #include "GunslingersCharacter.h"
 #include "UObject/ConstructorHelpers.h"
 #include "AIDirector.h"
+#include "ShotTraceBatcher.h"
+#include "ProjectileManager.h"
+#include "Engine/World.h"
 
 AGunslingersGameMode::AGunslingersGameMode()
 {
@@ -13,5 +16,31 @@ AGunslingersGameMode::AGunslingersGameMode()
 	{
 		DefaultPawnClass = PlayerPawnBPClass.Class;
 	}
-	AIDirector = CreateDefaultSubobject<AAIDirector>("AIDirector");
+	AIDirectorClass = AAIDirector::StaticClass();
+	ShotTraceBatcherClass = AShotTraceBatcher::StaticClass();
+	ProjectileManagerClass = AProjectileManager::StaticClass();
+}
+
+template<typename T>
+T* AGunslingersGameMode::SpawnManager(TSubclassOf<T> managerClass)
+{
+	if (!managerClass)
+	{
+		return nullptr;
+	}
+	FActorSpawnParameters SpawnParam;
+	SpawnParam.Owner = this;
+	SpawnParam.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParam.ObjectFlags |= RF_Transient;
+	return GetWorld()->SpawnActor<T>(managerClass, SpawnParam);
+}
+
+void AGunslingersGameMode::PreInitializeComponents()
+{
+	Super::PreInitializeComponents();
+
+	//The managers are real actors in the world (not subobjects) so they tick and everything else can find them through the game mode
+	AIDirector = SpawnManager<AAIDirector>(AIDirectorClass);
+	ShotTraceBatcher = SpawnManager<AShotTraceBatcher>(ShotTraceBatcherClass);
+	ProjectileManager = SpawnManager<AProjectileManager>(ProjectileManagerClass);
 }
@@ -14,11 +14,37 @@ class AGunslingersGameMode : public AGameModeBase
 public:
 	AGunslingersGameMode();
 
+	//Spawns the AI director into the world before any level actor begins play, so covers can register with it
+	virtual void PreInitializeComponents() override;
+
+	//Class of AI director to spawn
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "AI")
+	TSubclassOf<class AAIDirector> AIDirectorClass;
+
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "AI")
 	class AAIDirector* AIDirector;
 
+	//Class of shot trace batcher to spawn, weapons trace on their own if there is none
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Weapon")
+	TSubclassOf<class AShotTraceBatcher> ShotTraceBatcherClass;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Weapon")
+	class AShotTraceBatcher* ShotTraceBatcher;
+
+	//Class of projectile manager to spawn, projectile weapons fall back to hitscan if there is none
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Weapon")
+	TSubclassOf<class AProjectileManager> ProjectileManagerClass;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Weapon")
+	class AProjectileManager* ProjectileManager;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "AI")
 	int AliveEnemyCount;
+
+protected:
+	//Spawns one of the world wide managers (director, shot batcher, projectiles) as a transient actor owned by the game mode, nullptr if managerClass is not set
+	template<typename T>
+	T* SpawnManager(TSubclassOf<T> managerClass);
 	
 };
 
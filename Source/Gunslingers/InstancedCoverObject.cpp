@@ -0,0 +1,167 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "InstancedCoverObject.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "Misc/Crc.h"
+
+// Sets default values
+AInstancedCoverObject::AInstancedCoverObject()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	CoverInstances = CreateDefaultSubobject<UHierarchicalInstancedStaticMeshComponent>("CoverInstances");
+	SetRootComponent(CoverInstances);
+}
+
+void AInstancedCoverObject::CalculateSections(TArray<FInstancedCoverSection>& outSections) const
+{
+	const UStaticMesh* mesh = CoverInstances->GetStaticMesh();
+	if (mesh == nullptr)
+	{
+		return;
+	}
+
+	//Cover points in an instance's own space for each scale, moved onto every instance placed at that scale
+	TMap<FVector, TArray<FCoverPoint>> localPointsByScale;
+	TArray<FVector> sectionSums;
+	const float sectionRadiusSquared = SectionRadius * SectionRadius;
+	for (int32 i = 0; i < CoverInstances->GetInstanceCount(); i++)
+	{
+		FTransform instanceTransform;
+		if (!CoverInstances->GetInstanceTransform(i, instanceTransform, true))
+		{
+			continue;
+		}
+
+		const FVector scale = instanceTransform.GetScale3D();
+		TArray<FCoverPoint>* localPoints = localPointsByScale.Find(scale);
+		if (localPoints == nullptr)
+		{
+			localPoints = &localPointsByScale.Add(scale);
+			ACoverObject::CalculateMeshCoverPoints(mesh, FTransform(FQuat::Identity, FVector::ZeroVector, scale), CoverRange, LowCoverMaxHeight, CoverEdgeMergeAngle, MinCoverEdgeLength, *localPoints);
+		}
+		if (localPoints->Num() == 0)
+		{
+			continue;
+		}
+
+		//Join the first section close enough, the same way the cover generator groups its points
+		const FVector location = instanceTransform.GetLocation();
+		int32 section = INDEX_NONE;
+		for (int32 s = 0; s < outSections.Num(); s++)
+		{
+			if (FVector::DistSquared(sectionSums[s] / outSections[s].Instances.Num(), location) <= sectionRadiusSquared)
+			{
+				section = s;
+				break;
+			}
+		}
+		if (section == INDEX_NONE)
+		{
+			section = outSections.AddDefaulted();
+			sectionSums.Add(FVector::ZeroVector);
+		}
+		outSections[section].Instances.Add(i);
+		sectionSums[section] += location;
+
+		const FQuat rotation = instanceTransform.GetRotation();
+		for (const FCoverPoint& localPoint : *localPoints)
+		{
+			FCoverPoint point = localPoint;
+			point.Location = location + rotation.RotateVector(localPoint.Location);
+			point.Rotation = (rotation * localPoint.Rotation.Quaternion()).Rotator();
+			outSections[section].CoverPoints.Add(point);
+		}
+	}
+
+	for (int32 s = 0; s < outSections.Num(); s++)
+	{
+		outSections[s].Center = sectionSums[s] / outSections[s].Instances.Num();
+	}
+}
+
+uint32 AInstancedCoverObject::HashInstances() const
+{
+	uint32 hash = CoverInstances->GetStaticMesh() ? GetTypeHash(CoverInstances->GetStaticMesh()->GetFName()) : 0;
+	for (const FInstancedStaticMeshInstanceData& instance : CoverInstances->PerInstanceSMData)
+	{
+		hash = FCrc::MemCrc32(&instance.Transform, sizeof(instance.Transform), hash);
+	}
+	return hash;
+}
+
+void AInstancedCoverObject::BakeCoverPoints()
+{
+	Modify();
+	Sections.Reset();
+	CalculateSections(Sections);
+	for (FInstancedCoverSection& section : Sections)
+	{
+		ACoverObject::CalculateExposure(GetWorld(), section.CoverPoints);
+	}
+	CoverPointsBaked = true;
+	BakedTransform = GetActorTransform();
+	BakedInstancesHash = HashInstances();
+}
+
+bool AInstancedCoverObject::HasCurrentBake() const
+{
+	return CoverPointsBaked && BakedTransform.Equals(GetActorTransform()) && BakedInstancesHash == HashInstances();
+}
+
+ACoverObject* AInstancedCoverObject::GetInstanceCoverObject(int32 instance) const
+{
+	const int32 section = InstanceSections.IsValidIndex(instance) ? InstanceSections[instance] : INDEX_NONE;
+	return section != INDEX_NONE ? SectionCoverObjects[section] : nullptr;
+}
+
+// Called when the game starts or when spawned
+void AInstancedCoverObject::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (!HasCurrentBake())
+	{
+		Sections.Reset();
+		CalculateSections(Sections);
+	}
+
+	//Each section registers with the AI director as a cover object, there is only one for many instances and it has nothing to draw or collide with
+	InstanceSections.Init(INDEX_NONE, CoverInstances->GetInstanceCount());
+	for (int32 s = 0; s < Sections.Num(); s++)
+	{
+		ACoverObject* sectionCoverObject = ACoverObject::SpawnWithCoverPoints(GetWorld(), Sections[s].Center, Sections[s].CoverPoints, this);
+		//Cover movement reads how far out the points are from the cover object
+		if (sectionCoverObject)
+		{
+			sectionCoverObject->CoverRange = CoverRange;
+		}
+		SectionCoverObjects.Add(sectionCoverObject);
+		for (int32 instance : Sections[s].Instances)
+		{
+			if (InstanceSections.IsValidIndex(instance))
+			{
+				InstanceSections[instance] = s;
+			}
+		}
+	}
+}
+
+void AInstancedCoverObject::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	//The sections are spawned into the persistent level, so they would outlive a sublevel streaming out
+	for (ACoverObject* coverObject : SectionCoverObjects)
+	{
+		if (coverObject && !coverObject->IsPendingKill())
+		{
+			coverObject->Destroy();
+		}
+	}
+	SectionCoverObjects.Reset();
+	InstanceSections.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
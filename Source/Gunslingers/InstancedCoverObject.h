@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "CoverObject.h"
+#include "InstancedCoverObject.generated.h"
+
+//Instances of the cover mesh near each other, the AI director ranks the whole section as one cover
+USTRUCT()
+struct FInstancedCoverSection
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, Category = "Cover")
+	FVector Center = FVector::ZeroVector;
+
+	//Indices of the instances in the section
+	UPROPERTY(VisibleAnywhere, Category = "Cover")
+	TArray<int32> Instances;
+
+	//The cover points around every instance in the section, in world space
+	UPROPERTY(VisibleAnywhere, Category = "Cover")
+	TArray<FCoverPoint> CoverPoints;
+};
+
+//Many copies of one cover mesh drawn through a single hierarchical instanced mesh, for maps with too many crates and walls to have an actor each. Each instance gets the same cover points a cover object would,
+//and each section of nearby instances is handed to the AI director as a cover object with no mesh, so it is found by the same queries as every other cover
+UCLASS()
+class GUNSLINGERS_API AInstancedCoverObject : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	AInstancedCoverObject();
+
+	//Every cover mesh placed by this actor
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Components")
+	class UHierarchicalInstancedStaticMeshComponent* CoverInstances;
+
+	//How far each cover point sticks out from the side of its instance, the same as on a cover object
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	float CoverRange = 10.f;
+
+	//Instances up to this tall are low cover that can be shot over standing up
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	float LowCoverMaxHeight = 120.f;
+
+	//Sides of the collision hull that turn by less than this many degrees are merged into one cover point
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	float CoverEdgeMergeAngle = 30.f;
+
+	//Sides shorter than this after merging are too small to take cover behind
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	float MinCoverEdgeLength = 40.f;
+
+	//Instances within this distance of a section's centre join that section. Bigger sections mean fewer covers for the director to rank but a coarser choice between them
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Cover")
+	float SectionRadius = 600.f;
+
+	//The sections of the instances. Saved with the level once baked
+	UPROPERTY(VisibleAnywhere, Category = "Bake")
+	TArray<FInstancedCoverSection> Sections;
+
+	//Whether Sections were baked in the editor, so BeginPlay only has to load them
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Bake")
+	bool CoverPointsBaked = false;
+
+	//Where the actor was and what its instances were when it was baked, if either has changed since the sections are worked out again at runtime
+	UPROPERTY()
+	FTransform BakedTransform;
+
+	UPROPERTY()
+	uint32 BakedInstancesHash = 0;
+
+	//Works out the cover points of every instance and groups the instances into sections. The hull of the mesh is only worked out once for each scale the instances are placed at
+	void CalculateSections(TArray<FInstancedCoverSection>& outSections) const;
+
+	//Works out Sections now so they are saved with the level
+	UFUNCTION(CallInEditor, Category = "Bake")
+	void BakeCoverPoints();
+
+	//Whether the baked sections are there and nothing has moved since
+	bool HasCurrentBake() const;
+
+	//The cover object the director knows an instance's section by, nullptr before BeginPlay or if the instance has no cover points
+	UFUNCTION(BlueprintPure, Category = "Cover")
+	ACoverObject* GetInstanceCoverObject(int32 instance) const;
+
+protected:
+	//One per section, spawned on BeginPlay
+	UPROPERTY(Transient)
+	TArray<ACoverObject*> SectionCoverObjects;
+
+	//Section of each instance, INDEX_NONE if it has no cover points
+	TArray<int32> InstanceSections;
+
+	uint32 HashInstances() const;
+
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+
+	// Called when removed from the world, the sections go with it
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+};
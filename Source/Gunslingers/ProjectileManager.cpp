@@ -0,0 +1,202 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ProjectileManager.h"
+#include "DrawDebugHelpers.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "GunslingersGameMode.h"
+#include "Weapon.h"
+
+static TAutoConsoleVariable<int32> CVarDrawProjectiles(
+	TEXT("weapon.DrawProjectiles"),
+	0,
+	TEXT("If non-zero the projectile manager draws every projectile in flight."));
+
+// Sets default values
+AProjectileManager::AProjectileManager()
+{
+ 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+AProjectileManager* AProjectileManager::Get(const UObject* worldContextObject)
+{
+	AGunslingersGameMode* gameMode = Cast<AGunslingersGameMode>(UGameplayStatics::GetGameMode(worldContextObject));
+	return gameMode ? gameMode->ProjectileManager : nullptr;
+}
+
+void AProjectileManager::ResetPool()
+{
+	const int32 num = FMath::Max(MaxProjectiles, 0);
+	PositionX.SetNumZeroed(num);
+	PositionY.SetNumZeroed(num);
+	PositionZ.SetNumZeroed(num);
+	VelocityX.SetNumZeroed(num);
+	VelocityY.SetNumZeroed(num);
+	VelocityZ.SetNumZeroed(num);
+	GravityZ.SetNumZeroed(num);
+	TimeLeft.SetNumZeroed(num);
+	Radius.SetNumZeroed(num);
+	Weapons.Reset();
+	Weapons.SetNum(num);
+	Generations.SetNumZeroed(num);
+
+	//Lowest slots are handed out first so the used range stays as short as it can
+	FreeSlots.Reset(num);
+	for (int32 slot = num - 1; slot >= 0; slot--)
+	{
+		FreeSlots.Add(slot);
+	}
+	NumSlotsUsed = 0;
+	NumLive = 0;
+	PendingSweeps.Reset();
+}
+
+bool AProjectileManager::FireProjectile(AWeapon* weapon, const FVector& start, const FVector& velocity, float gravityScale, float radius, float lifetime)
+{
+	if (FreeSlots.Num() == 0 || lifetime <= 0.f)
+	{
+		return false;
+	}
+
+	const int32 slot = FreeSlots.Pop(false);
+	PositionX[slot] = start.X;
+	PositionY[slot] = start.Y;
+	PositionZ[slot] = start.Z;
+	VelocityX[slot] = velocity.X;
+	VelocityY[slot] = velocity.Y;
+	VelocityZ[slot] = velocity.Z;
+	GravityZ[slot] = GetWorld()->GetGravityZ() * gravityScale;
+	TimeLeft[slot] = lifetime;
+	Radius[slot] = FMath::Max(radius, 0.f);
+	Weapons[slot] = weapon;
+	NumSlotsUsed = FMath::Max(NumSlotsUsed, slot + 1);
+	NumLive++;
+	return true;
+}
+
+void AProjectileManager::FreeSlot(int32 slot)
+{
+	TimeLeft[slot] = 0.f;
+	Weapons[slot].Reset();
+	Generations[slot]++;
+	FreeSlots.Add(slot);
+	NumLive--;
+	//Let the used range shrink back once the top of it is empty
+	while (NumSlotsUsed > 0 && Weapons[NumSlotsUsed - 1].IsExplicitlyNull())
+	{
+		NumSlotsUsed--;
+	}
+}
+
+void AProjectileManager::CollectSweeps()
+{
+	//Results are only kept for the frame after they are queued, so anything that is not there by now never will be
+	UWorld* world = GetWorld();
+	FTraceDatum datum;
+	for (const FPendingSweep& sweep : PendingSweeps)
+	{
+		if (Generations[sweep.Slot] != sweep.Generation || !world->QueryTraceData(sweep.Trace, datum))
+		{
+			continue;
+		}
+		const FHitResult* hit = datum.OutHits.FindByPredicate([](const FHitResult& result) { return result.bBlockingHit; });
+		if (hit == nullptr)
+		{
+			continue;
+		}
+
+		//The weapon is gone if its owner died and dropped it, the projectile goes with it
+		AWeapon* weapon = Weapons[sweep.Slot].Get();
+		if (weapon)
+		{
+			weapon->ApplyShotHit(*hit, sweep.Direction);
+		}
+		FreeSlot(sweep.Slot);
+	}
+	PendingSweeps.Reset();
+}
+
+// Called when the game starts or when spawned
+void AProjectileManager::BeginPlay()
+{
+	Super::BeginPlay();
+
+	ResetPool();
+}
+
+// Called every frame
+void AProjectileManager::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	//Hits first, so nothing that has already hit is moved again
+	CollectSweeps();
+	if (NumLive == 0)
+	{
+		return;
+	}
+
+	//Remember where each projectile was so the sweep covers the whole of this frame's movement
+	const int32 num = NumSlotsUsed;
+	TArray<float> previousX(PositionX.GetData(), num);
+	TArray<float> previousY(PositionY.GetData(), num);
+	TArray<float> previousZ(PositionZ.GetData(), num);
+
+	//Every used slot is moved, free ones included, so the loops have no branches and the compiler can run them four or eight lanes at a time
+	float* RESTRICT px = PositionX.GetData();
+	float* RESTRICT py = PositionY.GetData();
+	float* RESTRICT pz = PositionZ.GetData();
+	float* RESTRICT vx = VelocityX.GetData();
+	float* RESTRICT vy = VelocityY.GetData();
+	float* RESTRICT vz = VelocityZ.GetData();
+	const float* RESTRICT gz = GravityZ.GetData();
+	float* RESTRICT timeLeft = TimeLeft.GetData();
+	for (int32 i = 0; i < num; i++)
+	{
+		//Semi-implicit Euler, gravity only ever pulls along Z
+		vz[i] += gz[i] * DeltaTime;
+		px[i] += vx[i] * DeltaTime;
+		py[i] += vy[i] * DeltaTime;
+		pz[i] += vz[i] * DeltaTime;
+		timeLeft[i] -= DeltaTime;
+	}
+
+	//Sweep each live projectile over the segment it just moved along, all of them go to the worker threads together with the rest of the frame's async traces
+	static const FName TraceTag(TEXT("Projectile"));
+	UWorld* world = GetWorld();
+	const bool draw = CVarDrawProjectiles.GetValueOnGameThread() != 0;
+	for (int32 slot = 0; slot < num; slot++)
+	{
+		if (Weapons[slot].IsExplicitlyNull())
+		{
+			continue;
+		}
+		AWeapon* weapon = Weapons[slot].Get();
+		if (timeLeft[slot] <= 0.f || weapon == nullptr)
+		{
+			FreeSlot(slot);
+			continue;
+		}
+
+		const FVector previous(previousX[slot], previousY[slot], previousZ[slot]);
+		const FVector current(px[slot], py[slot], pz[slot]);
+		FCollisionQueryParams params(TraceTag, true, weapon);
+		params.AddIgnoredActor(weapon->GetOwner());
+
+		FPendingSweep& sweep = PendingSweeps.AddDefaulted_GetRef();
+		sweep.Slot = slot;
+		sweep.Generation = Generations[slot];
+		sweep.Direction = (current - previous).GetSafeNormal();
+		sweep.Trace = Radius[slot] > 0.f
+			? world->AsyncSweepByChannel(EAsyncTraceType::Single, previous, current, ECC_Visibility, FCollisionShape::MakeSphere(Radius[slot]), params)
+			: world->AsyncLineTraceByChannel(EAsyncTraceType::Single, previous, current, ECC_Visibility, params);
+
+		if (draw)
+		{
+			DrawDebugLine(world, previous, current, FColor::Orange, false, -1.f, 0, 1.f);
+		}
+	}
+}
@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "WorldCollision.h"
+#include "ProjectileManager.generated.h"
+
+//Flies every travel-time bullet and rocket in the world without an actor each. Projectiles live in a fixed pool of slots stored as structure-of-arrays, are all moved in one pass each frame,
+//and are checked against the world with one async sweep per projectile per frame. A projectile that hits something is handed back to the weapon that fired it and its slot is reused
+UCLASS()
+class GUNSLINGERS_API AProjectileManager : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	AProjectileManager();
+
+	//Returns the manager of the world the object is in, or nullptr if the game mode does not have one
+	static AProjectileManager* Get(const UObject* worldContextObject);
+
+	//Most projectiles in flight at once, firing when the pool is full does nothing
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Weapon")
+	int32 MaxProjectiles = 1024;
+
+	//Launches a projectile from start with velocity, pulled down by gravityScale times the world's gravity. It hits the first thing its sphere of radius touches, or is dropped after lifetime seconds.
+	//The weapon's ApplyShotHit is called for the hit. Returns false if the pool is full
+	bool FireProjectile(class AWeapon* weapon, const FVector& start, const FVector& velocity, float gravityScale, float radius, float lifetime);
+
+	//Projectiles in flight
+	UFUNCTION(BlueprintPure, Category = "Weapon")
+	int32 GetNumProjectiles() const { return NumLive; }
+
+protected:
+	//State of every slot as structure-of-arrays, so moving them all is a straight run over each array
+	TArray<float> PositionX;
+	TArray<float> PositionY;
+	TArray<float> PositionZ;
+	TArray<float> VelocityX;
+	TArray<float> VelocityY;
+	TArray<float> VelocityZ;
+	TArray<float> GravityZ;
+	//Seconds left to live, zero or less for a free slot
+	TArray<float> TimeLeft;
+	//Only read when sweeping or hitting, so kept out of the arrays that are moved
+	TArray<float> Radius;
+	TArray<TWeakObjectPtr<class AWeapon>> Weapons;
+	//Bumped each time a slot is freed so sweeps still in flight for the last projectile in it are ignored
+	TArray<uint32> Generations;
+
+	//Free slots, taken from the back
+	TArray<int32> FreeSlots;
+	//Slots below this have been used, so only they are moved
+	int32 NumSlotsUsed = 0;
+	int32 NumLive = 0;
+
+	//A sweep over the distance a projectile moved in one frame
+	struct FPendingSweep
+	{
+		int32 Slot;
+		uint32 Generation;
+		FVector Direction;
+		FTraceHandle Trace;
+	};
+
+	TArray<FPendingSweep> PendingSweeps;
+
+	//Makes every slot free, sized to MaxProjectiles
+	void ResetPool();
+
+	void FreeSlot(int32 slot);
+
+	//Hands out hits from the sweeps queued last frame
+	void CollectSweeps();
+
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+
+public:
+	// Called every frame
+	virtual void Tick(float DeltaTime) override;
+
+};
@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShotTraceBatcher.h"
+#include "Engine/World.h"
+#include "Kismet/GameplayStatics.h"
+#include "GunslingersGameMode.h"
+#include "Weapon.h"
+
+// Sets default values
+AShotTraceBatcher::AShotTraceBatcher()
+{
+ 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+AShotTraceBatcher* AShotTraceBatcher::Get(const UObject* worldContextObject)
+{
+	AGunslingersGameMode* gameMode = Cast<AGunslingersGameMode>(UGameplayStatics::GetGameMode(worldContextObject));
+	return gameMode ? gameMode->ShotTraceBatcher : nullptr;
+}
+
+void AShotTraceBatcher::SubmitShot(AWeapon* weapon, const FVector& start, const FVector& end, const FVector& shotDirection, const FCollisionQueryParams& params)
+{
+	//The world runs every async trace requested this frame together on worker threads, so requesting it now is what puts it in the batch
+	FPendingShot& shot = PendingShots.AddDefaulted_GetRef();
+	shot.Weapon = weapon;
+	shot.ShotDirection = shotDirection;
+	shot.Trace = GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, start, end, ECC_Visibility, params);
+}
+
+// Called every frame
+void AShotTraceBatcher::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	//Results are only kept for the frame after they are queued, so everything that is there is handed out now and the rest waits
+	UWorld* world = GetWorld();
+	FTraceDatum datum;
+	for (int32 i = 0; i < PendingShots.Num(); i++)
+	{
+		const FPendingShot& shot = PendingShots[i];
+		if (world->QueryTraceData(shot.Trace, datum))
+		{
+			AWeapon* weapon = shot.Weapon.Get();
+			if (weapon && datum.OutHits.Num() > 0 && datum.OutHits[0].bBlockingHit)
+			{
+				weapon->ApplyShotHit(datum.OutHits[0], shot.ShotDirection);
+			}
+		}
+		else if (world->IsTraceHandleValid(shot.Trace, false))
+		{
+			continue;
+		}
+		//Handed out, or too old to ever be
+		PendingShots.RemoveAtSwap(i, 1, false);
+		i--;
+	}
+}
@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "WorldCollision.h"
+#include "ShotTraceBatcher.generated.h"
+
+//Gathers the hitscan shots of every weapon in a frame and traces them off the game thread as one batch of async traces. The hits are handed back to each weapon the frame after,
+//so forty enemies shooting cost forty trace requests instead of forty physics queries run one after another
+UCLASS()
+class GUNSLINGERS_API AShotTraceBatcher : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	AShotTraceBatcher();
+
+	//Returns the batcher of the world the object is in, or nullptr if the game mode does not have one
+	static AShotTraceBatcher* Get(const UObject* worldContextObject);
+
+	//Player shots are traced as they are fired so hits land the same frame, only the AI's shots wait for the batch
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Weapon")
+	bool SynchronousPlayerShots = true;
+
+	//Queues a shot from start to end. The weapon's ApplyShotHit is called with whatever blocks it once the batch comes back, unless the weapon has been destroyed by then
+	void SubmitShot(class AWeapon* weapon, const FVector& start, const FVector& end, const FVector& shotDirection, const FCollisionQueryParams& params);
+
+	//Shots waiting for their traces
+	UFUNCTION(BlueprintPure, Category = "Weapon")
+	int32 GetNumPendingShots() const { return PendingShots.Num(); }
+
+protected:
+	struct FPendingShot
+	{
+		TWeakObjectPtr<class AWeapon> Weapon;
+		FVector ShotDirection;
+		FTraceHandle Trace;
+	};
+
+	TArray<FPendingShot> PendingShots;
+
+public:
+	// Called every frame
+	virtual void Tick(float DeltaTime) override;
+
+};
@@ -6,6 +6,9 @@
 #include "DrawDebugHelpers.h"
 #include "Kismet/GameplayStatics.h"
 #include "GunslingersCharacter.h"
+#include "AIDirector.h"
+#include "ShotTraceBatcher.h"
+#include "ProjectileManager.h"
 
 
 // Sets default values
@@ -38,12 +41,25 @@ void AWeapon::FireWeapon()
 		//Shooting can only occur with ammo
 		else
 		{
+			AActor* weaponOwner = GetOwner();
+
+			//An enemy shoots at whichever player the director says it is reacting to. With nobody to shoot at the shot is not taken, so no round is spent and no animation plays
+			AGunslingersCharacter* player = nullptr;
+			if (IsEnemies)
+			{
+				AAIDirector* director = AAIDirector::Get(this);
+				player = director && weaponOwner ? Cast<AGunslingersCharacter>(director->SelectThreat(weaponOwner->GetActorLocation(), weaponOwner->GetActorForwardVector())) : nullptr;
+				if (player == nullptr)
+				{
+					return;
+				}
+			}
+
 			CurrentAmmo -= 1;
 
 			MeshComponent->PlayAnimation(FireAnim,false);
 
 			//Ray trace from player to crosshair location in space
-			AActor* weaponOwner = GetOwner();
 			if (weaponOwner)
 			{
 				//Two types of shooting, from the player or the enemy
@@ -58,32 +74,12 @@ void AWeapon::FireWeapon()
 
 					FVector endPoint = startPoint + (shotDirection * 100000);
 
-					//Trace parameters
-					FCollisionQueryParams collisionParam;
-					collisionParam.AddIgnoredActor(weaponOwner);
-					collisionParam.AddIgnoredActor(this);
-					collisionParam.bTraceComplex = true;
-
-					//Perform trace and store result in hit
-					FHitResult hit;
-					if (GetWorld()->LineTraceSingleByChannel(hit, startPoint, endPoint, ECC_Visibility, collisionParam))
-					{
-						AActor* hitActor = hit.GetActor();
-						UGameplayStatics::ApplyPointDamage(hitActor, WeaponDamage, shotDirection, hit, weaponOwner->GetInstigatorController(), this, DamageType);
-
-						//Any visual feedback or bullet line will go from the barrel to the final hit location but the actual line trace is from the camera; for now commented out
-
-						/*startPoint = MeshComponent->GetSocketLocation("MuzzleFlash");
-						endPoint = hit.Location;
-						DrawDebugLine(GetWorld(), startPoint, endPoint, FColor::Green, false, 1.0f, 0, 1.0f);*/
-
-					}					
+					TraceShot(startPoint, endPoint, shotDirection);
 				}
 				else
 				{
 					//Direction and points of trace
 					FVector startPoint = weaponOwner->GetActorLocation() + (FVector::UpVector * 50);
-					AGunslingersCharacter* player = Cast<AGunslingersCharacter>(GetWorld()->GetFirstPlayerController()->GetPawn());
 					float playerVelocity = player->GetVelocity().X;
 					FVector endPoint = player->GetMesh()->GetBoneLocation("spine_03");
 					FVector randomOffset = FVector(FMath::FRandRange(-Inaccuracy - playerVelocity, Inaccuracy + playerVelocity), FMath::FRandRange(-Inaccuracy - playerVelocity, Inaccuracy + playerVelocity), FMath::FRandRange(-Inaccuracy - playerVelocity, Inaccuracy + playerVelocity));
@@ -91,31 +87,75 @@ void AWeapon::FireWeapon()
 					FVector direction = endPoint - startPoint;
 					endPoint = startPoint + (direction * 100000);
 
-					//Trace parameters
-					FCollisionQueryParams collisionParam;
-					collisionParam.AddIgnoredActor(weaponOwner);
-					collisionParam.AddIgnoredActor(this);
-					collisionParam.bTraceComplex = true;
+					TraceShot(startPoint, endPoint, GetActorForwardVector());
+				}
+			}
+		}
+	}
+}
 
-					//Perform trace and store result in hit
-					FHitResult hit;
-					if (GetWorld()->LineTraceSingleByChannel(hit, startPoint, endPoint, ECC_Visibility, collisionParam))
-					{
-						AActor* hitActor = hit.GetActor();
-						UGameplayStatics::ApplyPointDamage(hitActor, WeaponDamage, GetActorForwardVector(), hit, weaponOwner->GetInstigatorController(), this, DamageType);
+void AWeapon::TraceShot(const FVector& start, const FVector& end, const FVector& shotDirection)
+{
+	//Projectiles leave from the muzzle but head for the point that was aimed at, so they still land under the crosshair
+	AProjectileManager* projectileManager = FireMode == FireModes::Projectile ? AProjectileManager::Get(this) : nullptr;
+	if (projectileManager)
+	{
+		const FVector muzzle = MeshComponent->DoesSocketExist("MuzzleFlash") ? MeshComponent->GetSocketLocation("MuzzleFlash") : start;
+		const FVector direction = (end - muzzle).GetSafeNormal();
+		projectileManager->FireProjectile(this, muzzle, direction * ProjectileSpeed, ProjectileGravityScale, ProjectileRadius, ProjectileLifetime);
+		return;
+	}
 
-						//Any visual feedback or bullet line will go from the barrel to the final hit location but the actual line trace is from the camera; for now commented out
+	//Trace parameters
+	FCollisionQueryParams collisionParam;
+	collisionParam.AddIgnoredActor(GetOwner());
+	collisionParam.AddIgnoredActor(this);
+	collisionParam.bTraceComplex = true;
 
+	//Enemy shots, and player shots unless the batcher is told otherwise, wait for the frame's batch of traces
+	AShotTraceBatcher* batcher = AShotTraceBatcher::Get(this);
+	if (batcher && (IsEnemies || !batcher->SynchronousPlayerShots))
+	{
+		batcher->SubmitShot(this, start, end, shotDirection, collisionParam);
+		return;
+	}
 
-						//startPoint = MeshComponent->GetSocketLocation("MuzzleFlash");
-						//endPoint = hit.Location;
-						//DrawDebugLine(GetWorld(), startPoint, endPoint, FColor::Green, false, 1.0f, 0, 1.0f);
+	//Perform trace and store result in hit
+	FHitResult hit;
+	if (GetWorld()->LineTraceSingleByChannel(hit, start, end, ECC_Visibility, collisionParam))
+	{
+		ApplyShotHit(hit, shotDirection);
+	}
+}
 
-					}
-				}
-			}
+void AWeapon::ApplyShotHit(const FHitResult& hit, const FVector& shotDirection)
+{
+	//The owner may have died while the shot was in the batch, the hit still lands but nobody is credited with it
+	AActor* weaponOwner = GetOwner();
+	AController* instigator = weaponOwner ? weaponOwner->GetInstigatorController() : nullptr;
+	UGameplayStatics::ApplyPointDamage(hit.GetActor(), WeaponDamage, shotDirection, hit, instigator, this, DamageType);
+	if (SplashRadius > 0.f)
+	{
+		//What was hit directly has already taken its damage
+		TArray<AActor*> ignoredActors = { hit.GetActor(), weaponOwner };
+		UGameplayStatics::ApplyRadialDamage(this, WeaponDamage, hit.ImpactPoint, SplashRadius, DamageType, ignoredActors, this, instigator);
+	}
+
+	if (!IsEnemies)
+	{
+		//Let the AI know where the player is shooting so they stay out of it
+		AAIDirector* director = AAIDirector::Get(this);
+		if (director)
+		{
+			director->ReportShot(hit.Location);
 		}
 	}
+
+	//Any visual feedback or bullet line will go from the barrel to the final hit location but the actual line trace is from the camera; for now commented out
+
+	/*FVector startPoint = MeshComponent->GetSocketLocation("MuzzleFlash");
+	FVector endPoint = hit.Location;
+	DrawDebugLine(GetWorld(), startPoint, endPoint, FColor::Green, false, 1.0f, 0, 1.0f);*/
 }
 
 //Reload logic
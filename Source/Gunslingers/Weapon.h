@@ -6,6 +6,14 @@
 #include "GameFramework/Actor.h"
 #include "Weapon.generated.h"
 
+//How a weapon's shots reach what they are aimed at
+UENUM(BlueprintType)
+enum FireModes
+{
+	Hitscan UMETA(DisplayName = "Hitscan"),
+	Projectile UMETA(DisplayName = "Projectile")
+};
+
 UCLASS()
 class GUNSLINGERS_API AWeapon : public AActor
 {
@@ -55,6 +63,30 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Weapon")
 	float WeaponDamage = 33.f;
 
+	//Hitscan shots land the moment they are fired, projectiles travel and drop and are flown by the projectile manager
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Weapon")
+	TEnumAsByte<FireModes> FireMode = FireModes::Hitscan;
+
+	//Speed a projectile leaves the muzzle at
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Weapon|Projectile")
+	float ProjectileSpeed = 20000.f;
+
+	//How much of the world's gravity pulls on a projectile, zero flies straight
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Weapon|Projectile")
+	float ProjectileGravityScale = 1.f;
+
+	//Radius of the sphere swept along a projectile's path, zero traces a line
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Weapon|Projectile")
+	float ProjectileRadius = 0.f;
+
+	//Seconds a projectile flies before it is dropped if it has not hit anything
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Weapon|Projectile")
+	float ProjectileLifetime = 3.f;
+
+	//Anything within this distance of a hit also takes the weapon's damage, falling off to nothing at the edge, for rockets and other explosives. Zero only damages what was hit
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Weapon")
+	float SplashRadius = 0.f;
+
 	//Animation that plays when the weapon fires
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Weapon")
 	UAnimSequence* FireAnim;
@@ -70,6 +102,9 @@ protected:
 	UFUNCTION()
 	void OnTimerEnd();
 
+	//Fires a projectile from the muzzle towards end in projectile mode, otherwise traces a shot from start to end, straight away for the player if the batcher says so, otherwise through the shot trace batcher
+	void TraceShot(const FVector& start, const FVector& end, const FVector& shotDirection);
+
 
 public:	
 	// Called every frame
@@ -83,4 +118,7 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Weapon")
 	void ReloadWeapon();
 
+	//Damages whatever a shot hit, called when its trace comes back
+	void ApplyShotHit(const FHitResult& hit, const FVector& shotDirection);
+
 };